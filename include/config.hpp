@@ -5,9 +5,12 @@
 #include <vector>
 
 namespace CONFIG {
-    const char* WINDOW_NAME = "Engine";
+    const char* const WINDOW_NAME = "Engine";
     const RGBA WINDOW_COLOR = {0.1f, 0.1f, 0.1f, 1.0f};
     const bool UNCAPPED_FRAMES = false;
+    const int HEADLESS_WIDTH = 1920; // offscreen framebuffer size for --headless
+    const int HEADLESS_HEIGHT = 1080;
+    const int HEADLESS_FRAMES = 600; // frames rendered by --headless when no count is given
     const bool OUT_FPS = true;
 
     const float CAMERA_MOVEMENT_SPEED = 5.0f;
@@ -20,15 +23,55 @@ namespace CONFIG {
     const int MIN_FRAMES_PER_CURSOR_TOGGLE = 30;
 
     const std::string SHADER_PATH = "include/shaders/";
+    const std::string DEPTH_SHADER_PATH = "include/shaders/depth/"; // position only program for the depth pre-pass
+    const bool SHADER_CACHE = true; // reuse linked program binaries between runs
+    const std::string SHADER_CACHE_PATH = "shader_cache/";
+    const int TEXTURE_ARRAY_INITIAL_LAYERS = 4; // arrays double when full
+    const unsigned int TEXTURE_UPLOAD_BUDGET = 1 << 23; // bytes of streamed texture uploads per frame
+    const unsigned int TEXTURE_DECODE_THREADS = 0; // 0 uses half the hardware threads
+    const bool TEXTURE_COMPRESSION = true; // BC1/BC3/BC4 with cpu built mips, cached between runs
+    const std::string TEXTURE_CACHE_PATH = "texture_cache/";
     const std::string FBX_ICOSPHERE_PATH = "res/meshes/icosphere.fbx";
     const std::string BLUEPRINT_TEXTURE_PATH = "res/textures/blueprint.png";
     const std::string WHITE_TEXTURE_PATH = "res/textures/white.jpg";
 
     const float BOX_SIZE = 15.0f;
     const int NUM_ICOSPHERES = 20;
+    const int NUM_POINT_LIGHTS = 256;
+    const float POINT_LIGHT_RADIUS = 3.0f;
+    const float NEAR_PLANE = 0.1f;
+    const float FAR_PLANE = 200.0f;
     const float ICOSPHERE_RADIUS = 1.0f;
     const float ICOSPHERE_MAX_START_VELOCITY = 5.f;
 
+    const bool FRUSTUM_CULLING = true; // skip instances whose bounds are fully outside the view
+    const bool MESH_LOD = true; // pick a decimated level per instance from its size on screen
+    const int MESH_LOD_LEVELS = 3; // levels built per mesh at load, including the full one (at most MAX_MESH_LODS)
+    const int MESH_LOD_BASE_GRID = 8; // clustering cells across a mesh's bounds for level 1, halved per level
+    const float MESH_LOD_SWITCH_RADIUS = 48.0f; // projected pixel radius below which level 1 is used, halved per level
+    const float MESH_LOD_HYSTERESIS = 0.15f; // fraction past a switch radius needed before changing level
+    const bool DEPTH_PREPASS = true; // lay down opaque depth first so the lit pass shades each pixel once
+    const bool OCCLUSION_CULLING = true; // skip instances hidden behind the nearest icospheres, rasterized on the cpu
+    const int OCCLUSION_BUFFER_WIDTH = 256; // cpu depth buffer size, rounded up to whole tiles
+    const int OCCLUSION_BUFFER_HEIGHT = 144;
+    const int OCCLUSION_MAX_OCCLUDERS = 32; // nearest frustum visible icospheres drawn as occluders
+    const unsigned int OCCLUSION_THREADS = 0; // workers started with the buffer, 0 uses every hardware thread
+    const bool RENDER_STATS = false; // print render queue state changes before and after sorting
+    const bool GPU_PROFILER = true; // time render passes on the gpu and print their averages next to the fps
+
+    const unsigned int GEOMETRY_POOL_VERTICES = 1 << 18; // shared vertex buffer capacity
+    const unsigned int GEOMETRY_POOL_INDICES = 1 << 20; // shared index buffer capacity
+    const unsigned int STREAM_BUFFER_FRAME_SIZE = 1 << 21; // bytes of uniform, light and draw data per frame in flight, instances come on top
+
+    const bool PHYSICS_STATS = false; // per-phase timers and counters, see getPhysicsStats()
+    const float PHYSICS_SLEEP_SPEED = 0.05f; // bodies slower than this count as sleeping in the stats
+
+    const bool PHYSICS_LOD = true;
+    const float PHYSICS_LOD_HALF_DISTANCE = 60.0f; // past this bodies step every 2nd frame
+    const float PHYSICS_LOD_QUARTER_DISTANCE = 120.0f; // and past this every 4th
+    const float PHYSICS_LOD_HYSTERESIS = 0.1f; // fraction of a threshold a body must cross back over to change tier
+    const int PHYSICS_LOD_REBALANCE_BUDGET = 256; // bodies re-tiered per step
+
     const int VERTEX_LENGTH = 8;
     const int CUBE_VERTEX_COUNT = 36;
 
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "types.hpp"
+#include "utilities.hpp"
+#include <cstdint>
+#include <vector>
+
+// world space bounding spheres in SoA so the test can take CULL_LANES at a time. the arrays
+// are padded to a multiple of CULL_LANES with spheres that can never be visible
+constexpr int CULL_LANES = 8;
+
+struct CullSpheres {
+    std::vector<float> x, y, z, radius;
+    unsigned int count = 0;
+};
+
+// the mesh's load time bounds moved by each object's model_matrix, or position and radius
+// for objects without a mesh
+void gatherCullSpheres(const std::vector<SceneObject>& objects, CullSpheres& spheres);
+
+// fills visible with the indices of every sphere touching the frustum, in order, and returns
+// how many there are. picks the AVX2 path at runtime when the cpu has it
+unsigned int cullSpheres(const Frustum& frustum, const CullSpheres& spheres, std::vector<uint32_t>& visible);
+
+bool cullingUsesAvx2();
+
+// what lod selection needs from the camera. pixels_per_unit is the viewport height over
+// 2 tan(fov / 2), so radius * pixels_per_unit / distance is a sphere's projected radius in pixels
+struct LodView {
+    glm::vec3 camera_position = glm::vec3(0.0f);
+    float pixels_per_unit = 1.0f;
+};
+
+LodView makeLodView(const glm::vec3& camera_position, float fov_degrees, int viewport_height);
+
+// cullSpheres, then each visible sphere picks a level from its projected radius and is put
+// in that level's bucket, so every bucket is one instanced draw. lods holds each object's
+// level across frames (resized as needed) so the hysteresis can see the previous choice
+void cullSpheresLod(const Frustum& frustum, const CullSpheres& spheres, const LodView& view, unsigned int lod_count,
+                    std::vector<uint8_t>& lods, std::vector<uint32_t>& visible, std::vector<uint32_t> buckets[MAX_MESH_LODS]);
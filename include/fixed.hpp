@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// signed 16.16 fixed point. everything is integer maths, so results are the same on every
+// compiler and flag combination (no fma contraction, no fast-math reassociation). 16.16 keeps
+// products inside int64 so the loops can still be vectorised, which 32.32 would not allow
+struct Fixed {
+    static constexpr int FRACTION_BITS = 16;
+    static constexpr int32_t ONE = 1 << FRACTION_BITS;
+
+    int32_t raw = 0;
+
+    constexpr Fixed() = default;
+    // float -> fixed is only deterministic because scaling by a power of two is exact
+    explicit Fixed(float value) : raw(static_cast<int32_t>(std::lround(value * static_cast<float>(ONE)))) {}
+    explicit operator float() const { return static_cast<float>(raw) / static_cast<float>(ONE); }
+
+    static constexpr Fixed fromRaw(int32_t raw_value) {
+        Fixed value;
+        value.raw = raw_value;
+        return value;
+    }
+};
+
+inline Fixed operator+(Fixed a, Fixed b) { return Fixed::fromRaw(a.raw + b.raw); }
+inline Fixed operator-(Fixed a, Fixed b) { return Fixed::fromRaw(a.raw - b.raw); }
+inline Fixed operator-(Fixed a) { return Fixed::fromRaw(-a.raw); }
+inline Fixed operator*(Fixed a, Fixed b) {
+    return Fixed::fromRaw(static_cast<int32_t>((static_cast<int64_t>(a.raw) * b.raw) >> Fixed::FRACTION_BITS));
+}
+inline Fixed operator/(Fixed a, Fixed b) {
+    return Fixed::fromRaw(static_cast<int32_t>((static_cast<int64_t>(a.raw) * Fixed::ONE) / b.raw));
+}
+
+inline Fixed& operator+=(Fixed& a, Fixed b) { return a = a + b; }
+inline Fixed& operator-=(Fixed& a, Fixed b) { return a = a - b; }
+inline Fixed& operator*=(Fixed& a, Fixed b) { return a = a * b; }
+
+inline bool operator<(Fixed a, Fixed b) { return a.raw < b.raw; }
+inline bool operator>(Fixed a, Fixed b) { return a.raw > b.raw; }
+inline bool operator<=(Fixed a, Fixed b) { return a.raw <= b.raw; }
+inline bool operator>=(Fixed a, Fixed b) { return a.raw >= b.raw; }
+inline bool operator==(Fixed a, Fixed b) { return a.raw == b.raw; }
+inline bool operator!=(Fixed a, Fixed b) { return a.raw != b.raw; }
+
+// floor(sqrt) by the bit-by-bit method. the argument is widened to 32.32 first so
+// the root comes out as 16.16 directly
+inline Fixed fixedSqrt(Fixed value) {
+    if (value.raw <= 0) return Fixed();
+    uint64_t n = static_cast<uint64_t>(value.raw) << Fixed::FRACTION_BITS;
+    uint64_t result = 0;
+    uint64_t bit = uint64_t(1) << 62;
+    while (bit > n) bit >>= 2;
+    while (bit != 0) {
+        if (n >= result + bit) {
+            n -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return Fixed::fromRaw(static_cast<int32_t>(result));
+}
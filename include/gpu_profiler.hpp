@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// GPU PROFILER
+// render passes are bracketed with GL_TIMESTAMP queries from a fixed pool. a frame's queries
+// are only read GPU_PROFILER_LATENCY frames later, and only if the driver says they are ready,
+// so glGetQueryObject never waits on the gpu. works anywhere ARB_timer_query is core
+// (including llvmpipe), timestamps rather than GL_TIME_ELAPSED so passes may nest.
+// one span per frame can also count fragment shader invocations (a GL 4.6 pipeline statistics
+// query), read back the same way, which is what shows how much overdraw the lit pass has
+constexpr int GPU_PROFILER_LATENCY = 4; // frames of queries in flight
+constexpr int GPU_PROFILER_MAX_PASSES = 16; // per frame
+constexpr int GPU_PROFILER_AVERAGE_FRAMES = 60;
+
+struct GpuPassTiming {
+    const char* name = nullptr;
+    float last_ms = 0.0f;
+    float average_ms = 0.0f; // over the last GPU_PROFILER_AVERAGE_FRAMES results
+    float history[GPU_PROFILER_AVERAGE_FRAMES] = {};
+    int history_count = 0;
+    int history_cursor = 0;
+};
+
+struct GpuProfilerFrame {
+    unsigned int queries[GPU_PROFILER_MAX_PASSES][2] = {}; // begin, end
+    const char* names[GPU_PROFILER_MAX_PASSES] = {};
+    int pass_count = 0;
+    unsigned int fragment_query = 0;
+    bool fragments_counted = false;
+    bool pending = false;
+};
+
+struct GpuProfiler {
+    GpuProfilerFrame frames[GPU_PROFILER_LATENCY];
+    int frame = 0;
+    int open_passes[GPU_PROFILER_MAX_PASSES] = {}; // stack of indices into the current frame
+    int open_count = 0;
+    int dropped_opens = 0; // passes begun past GPU_PROFILER_MAX_PASSES, always the innermost ones
+    unsigned int dropped_frames = 0; // results still not ready after GPU_PROFILER_LATENCY frames
+    std::vector<GpuPassTiming> timings; // one per distinct pass name, in first seen order
+    bool counting_fragments = false;
+    uint64_t fragment_invocations = 0; // latest frame read back, 0 until one is
+};
+
+GpuProfiler* createGpuProfiler();
+void destroyGpuProfiler(GpuProfiler* profiler);
+
+// reads back the oldest frame's results (when ready) and starts recording a new frame
+void beginGpuFrame(GpuProfiler* profiler);
+// passes must be balanced within a frame. names must outlive the profiler, string
+// literals in practice
+void beginGpuPass(GpuProfiler* profiler, const char* name);
+void endGpuPass(GpuProfiler* profiler);
+// at most one span per frame, can't nest
+void beginFragmentCount(GpuProfiler* profiler);
+void endFragmentCount(GpuProfiler* profiler);
+
+// "name avg_ms" for every pass and the fragment count, for printing next to the cpu frame time
+std::string formatGpuTimings(const GpuProfiler* profiler);
@@ -0,0 +1,20 @@
+#pragma once
+
+// HEADLESS
+// a gl context with no window or display, for build and benchmark hosts. EGL picks the
+// surfaceless platform (mesa's llvmpipe on machines without a gpu) and the frame is rendered
+// into an offscreen framebuffer instead of a swapchain. only available when cmake found EGL
+struct HeadlessContext {
+    void* display = nullptr; // EGLDisplay
+    void* context = nullptr; // EGLContext
+    unsigned int framebuffer = 0;
+    unsigned int color = 0;
+    unsigned int depth = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// makes the context current, loads gl through glad and binds a width x height framebuffer.
+// returns nullptr (after saying why) when EGL is missing or no core context can be made
+HeadlessContext* createHeadlessContext(int width, int height);
+void destroyHeadlessContext(HeadlessContext* headless);
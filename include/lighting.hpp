@@ -0,0 +1,68 @@
+#pragma once
+
+#include "render.hpp"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// CLUSTERED LIGHTING
+// the view frustum is cut into CLUSTER_X x CLUSTER_Y screen tiles and CLUSTER_Z depth slices
+// spaced exponentially between the near and far planes. every frame each cluster gets the
+// list of point lights whose sphere touches its view space box, and the fragment shader only
+// loops over the list for the cluster it lands in. the grid size and bindings are repeated
+// in fragmentShader.frag and must match
+constexpr int CLUSTER_X = 16;
+constexpr int CLUSTER_Y = 9;
+constexpr int CLUSTER_Z = 24;
+constexpr int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+constexpr int LIGHT_LANES = 8;
+
+constexpr unsigned int POINT_LIGHT_BINDING = 2;
+constexpr unsigned int LIGHT_CLUSTER_BINDING = 3;
+constexpr unsigned int LIGHT_INDEX_BINDING = 4;
+
+// std430 layout of the PointLights buffer
+struct PointLight {
+    glm::vec4 position_radius; // world space, w is where the light fades to nothing
+    glm::vec4 color; // rgb, w unused
+};
+static_assert(sizeof(PointLight) == 32, "PointLight must match the std430 PointLights buffer");
+
+struct LightClusterStats {
+    uint32_t lights = 0;
+    uint32_t references = 0; // total entries across every cluster's list
+    uint32_t max_per_cluster = 0;
+};
+
+// view space light spheres in SoA, padded to a multiple of LIGHT_LANES with lights that
+// never touch anything. ids are the indices into the PointLight list
+struct LightLanes {
+    std::vector<float> x, y, z, radius;
+    std::vector<uint32_t> ids;
+};
+
+struct LightClusters {
+    // view space box of every cluster, rebuilt each frame from the projection
+    std::vector<glm::vec3> bounds_min, bounds_max;
+    // two entries per cluster, offset into indices and count
+    std::vector<uint32_t> ranges;
+    std::vector<uint32_t> indices;
+
+    // every light, then the ones reaching the current slice, then the current row of tiles
+    // in it. each level only tests the level above, so a tile sees just the lights nearby
+    LightLanes lights, slice, row;
+
+    LightClusterStats stats;
+};
+
+// the vec4 the shader turns gl_FragCoord and view depth into a cluster with: x and y scale
+// pixels to tiles, z and w map log(depth) to a slice
+glm::vec4 clusterScale(float near_plane, float far_plane, int width, int height);
+
+// projection must be a perspective projection made with near_plane and far_plane
+void buildLightClusters(LightClusters& clusters, const std::vector<PointLight>& lights,
+                        const glm::mat4& projection, const glm::mat4& view, float near_plane, float far_plane);
+
+// writes the lights, cluster ranges and index list into this frame's segment and binds them
+// as shader storage ranges
+void uploadLightClusters(RingBuffer* ring, const LightClusters& clusters, const std::vector<PointLight>& lights);
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "culling.hpp"
+#include <glm/glm.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// OCCLUSION CULLING
+// designated occluders are rasterized on the cpu into a small depth buffer, then instances
+// whose bounding sphere is behind everything drawn in its screen rectangle are dropped before
+// submission. the buffer is cut into OCCLUSION_TILE_WIDTH x OCCLUSION_TILE_HEIGHT tiles that
+// the buffer's worker threads rasterize independently, OCCLUSION_LANES pixels of a row at a
+// time. workers are started once with the buffer and woken twice a frame, first to set up and
+// bin the triangles of whole occluders (each into its own bins), then to rasterize tiles. each
+// tile then keeps the farthest depth of every OCCLUSION_HIZ_BLOCK square (the hierarchical z)
+// and spheres are only tested against those.
+// depth is 1 / w, so it interpolates linearly across a triangle on screen and 0 means nothing
+// was drawn. occluders must lie inside what is actually rendered for the culling to be safe
+constexpr int OCCLUSION_TILE_WIDTH = 32;
+constexpr int OCCLUSION_TILE_HEIGHT = 16;
+constexpr int OCCLUSION_HIZ_BLOCK = 8;
+constexpr int OCCLUSION_LANES = 8;
+
+// positions and triangle indices only, counter clockwise seen from outside
+struct OccluderMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+};
+
+struct Occluder {
+    const OccluderMesh* mesh = nullptr;
+    glm::mat4 model = glm::mat4(1.0f);
+};
+
+struct OcclusionStats {
+    uint32_t occluders = 0;
+    uint32_t triangles = 0; // left after backface, near plane and off screen rejection
+    uint32_t tested = 0;
+    uint32_t occluded = 0;
+    float raster_ms = 0.0f;
+};
+
+// a triangle ready to rasterize: three edge functions and the depth plane in pixels, and its
+// pixel bounds. empty bounds mark a rejected triangle
+struct OcclusionTriangle {
+    float edge_x[3], edge_y[3], edge_c[3];
+    float depth_x, depth_y, depth_c;
+    int min_x, min_y, max_x, max_y;
+};
+
+// one worker's tile bins, filled while setting up its occluders
+struct OcclusionBins {
+    std::vector<std::vector<uint32_t>> tiles; // triangle indices touching each tile
+    uint32_t triangles = 0;
+};
+
+struct OcclusionBuffer {
+    int width = 0; // whole tiles
+    int height = 0;
+    int tiles_x = 0;
+    int tiles_y = 0;
+    std::vector<float> depth; // row major, row 0 at the bottom like ndc
+    std::vector<float> hiz; // (width / OCCLUSION_HIZ_BLOCK) x (height / OCCLUSION_HIZ_BLOCK)
+
+    // what the occluders were drawn with, the sphere test projects the same way
+    glm::mat4 projection = glm::mat4(1.0f);
+    glm::mat4 view = glm::mat4(1.0f);
+
+    std::vector<OcclusionTriangle> triangles;
+    std::vector<OcclusionBins> bins; // one per worker, the calling thread is worker 0
+
+    OcclusionStats stats;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex; // guards everything down to stopping
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::function<void(unsigned int, size_t)> job; // (worker, job index)
+    size_t job_count = 0;
+    std::atomic<size_t> next_job = 0;
+    unsigned int pass = 0; // bumped to wake the workers
+    unsigned int busy = 0; // workers still in the current pass
+    bool stopping = false;
+};
+
+// width and height are rounded up to whole tiles. thread_count 0 uses every hardware thread,
+// the thread calling renderOccluders counts as one of them
+OcclusionBuffer* createOcclusionBuffer(int width, int height, unsigned int thread_count = 0);
+void destroyOcclusionBuffer(OcclusionBuffer* buffer);
+
+// interleaved vertices (CONFIG::VERTEX_LENGTH floats, position first) and one index list
+OccluderMesh makeOccluderMesh(const std::vector<float>& vertices, const std::vector<unsigned int>& indices);
+
+// clears the buffer, rasterizes every occluder and rebuilds the hierarchical z. projection must
+// be a perspective projection, triangles reaching past its near plane are skipped rather than clipped
+void renderOccluders(OcclusionBuffer& buffer, const std::vector<Occluder>& occluders,
+                     const glm::mat4& projection, const glm::mat4& view);
+
+// removes the spheres hidden behind the occluders from visible, keeping the order of the
+// rest, and returns how many are left. spheres reaching the near plane are always kept
+unsigned int cullOccludedSpheres(OcclusionBuffer& buffer, const CullSpheres& spheres, std::vector<uint32_t>& visible);
@@ -0,0 +1,215 @@
+#pragma once
+
+#include "types.hpp"
+#include "fixed.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// one of these is produced per updatePhysics call. the layout is fixed (plain
+// data, no padding surprises) so external tooling can poll it straight from memory
+struct PhysicsStepStats {
+    uint64_t step_index;
+
+    double integrate_ms;
+    double walls_ms;
+    double pairs_ms; // narrowphase only, solver time is subtracted out
+    double solver_ms;
+    double finalize_ms;
+    double total_ms;
+
+    uint32_t body_count;
+    uint32_t candidate_pairs;
+    uint32_t contacts;
+    uint32_t solver_iterations;
+    uint32_t sleeping_bodies;
+    float max_penetration;
+
+    uint32_t active_bodies; // less than body_count when the lod scheduler skipped some
+};
+static_assert(std::is_standard_layout_v<PhysicsStepStats> && std::is_trivially_copyable_v<PhysicsStepStats>);
+
+// adds the elapsed time of its scope onto a stats field. the disabled
+// specialisation is empty so the whole thing compiles away
+template <bool Enabled>
+class ScopedPhaseTimer {
+public:
+    explicit ScopedPhaseTimer(double& out_ms) : out_ms(out_ms), start(std::chrono::steady_clock::now()) {}
+    ~ScopedPhaseTimer() {
+        out_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+    ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+
+private:
+    double& out_ms;
+    std::chrono::steady_clock::time_point start;
+};
+
+template <>
+class ScopedPhaseTimer<false> {
+public:
+    explicit ScopedPhaseTimer(double&) {}
+};
+
+// the tunables updatePhysics used to hardcode, split out so parameter sweeps can vary them per world
+struct PhysicsParams {
+    float box_size;
+    float restitution;
+    float damping;
+    float max_velocity;
+    float min_separation_velocity;
+};
+
+PhysicsParams defaultPhysicsParams();
+
+void updatePhysics(std::vector<SceneObject>& objects, float delta_time);
+void updatePhysics(std::vector<SceneObject>& objects, float delta_time, const PhysicsParams& params);
+
+// BROADPHASE
+// sweep and prune on x. callers fill in one interval per body (or volume) and build,
+// queries then only touch entries whose min_x falls in [min_x - max_extent, max_x]
+struct BroadphaseEntry {
+    float min_x;
+    float max_x;
+    uint32_t id;
+};
+
+struct Broadphase {
+    std::vector<BroadphaseEntry> entries;
+    float max_extent = 0.0f;
+};
+
+void buildBroadphase(Broadphase& broadphase);
+
+// calls visit(id) for every entry whose x interval overlaps [min_x, max_x]
+template <typename Visit>
+void queryBroadphase(const Broadphase& broadphase, float min_x, float max_x, Visit&& visit) {
+    const auto& entries = broadphase.entries;
+    float lowest = min_x - broadphase.max_extent;
+    auto it = std::lower_bound(entries.begin(), entries.end(), lowest,
+                               [](const BroadphaseEntry& entry, float x) { return entry.min_x < x; });
+    for (; it != entries.end() && it->min_x <= max_x; ++it) {
+        if (it->max_x >= min_x) visit(it->id);
+    }
+}
+
+// PHYSICS LOD
+// bodies are put in tiers that step every 1st, 2nd or 4th updatePhysicsLod call,
+// accumulating the skipped time and integrating it in one go when their turn comes
+enum PhysicsTier : uint8_t {
+    PHYSICS_TIER_FULL = 0,
+    PHYSICS_TIER_HALF = 1,
+    PHYSICS_TIER_QUARTER = 2,
+};
+
+struct PhysicsLodScheduler {
+    std::vector<uint8_t> tiers;
+    std::vector<float> pending_time; // simulated time each body still owes
+    size_t rebalance_cursor = 0;
+    uint64_t step = 0;
+
+    // scratch, kept around to avoid reallocating every step
+    std::vector<uint8_t> is_active;
+    std::vector<uint32_t> active;
+    std::vector<SceneObject> active_objects;
+    std::vector<float> active_delta_times;
+    Broadphase reach;
+};
+
+// tiers come from the distance to camera_position and whether the body is inside the view,
+// and only CONFIG::PHYSICS_LOD_REBALANCE_BUDGET bodies are re-tiered per call. a skipped body
+// that could reach an active one this step is pulled into the step so contacts are never missed
+void updatePhysicsLod(std::vector<SceneObject>& objects, PhysicsLodScheduler& lod, float delta_time,
+                      const glm::vec3& camera_position, const glm::mat4& view_projection);
+
+// TRIGGERS
+// sensor volumes that never collide, only report which bodies overlap them. all results
+// for a step live in flat arrays, there are no callbacks
+enum TriggerShape : uint8_t {
+    TRIGGER_BOX = 0,
+    TRIGGER_SPHERE = 1,
+};
+
+struct TriggerVolume {
+    TriggerShape shape;
+    glm::vec3 center;
+    glm::vec3 half_extents; // TRIGGER_BOX
+    float radius; // TRIGGER_SPHERE
+};
+
+struct TriggerEvent {
+    uint32_t trigger;
+    uint32_t body;
+};
+
+struct TriggerSystem {
+    std::vector<TriggerVolume> volumes;
+
+    // bodies currently inside, grouped per volume: volume t owns
+    // inside[inside_offsets[t] .. inside_offsets[t + 1]), sorted by body index
+    std::vector<uint32_t> inside_offsets;
+    std::vector<uint32_t> inside;
+
+    // what changed during the last updateTriggers, ordered by trigger then body
+    std::vector<TriggerEvent> entered;
+    std::vector<TriggerEvent> exited;
+
+    // scratch
+    Broadphase broadphase;
+    std::vector<uint32_t> previous_offsets;
+    std::vector<uint32_t> previous_inside;
+    std::vector<uint32_t> candidates;
+};
+
+// run once per step after the physics update. rebuilds occupancy for every volume in one
+// batch, using the broadphase over the bodies to find candidates
+void updateTriggers(TriggerSystem& triggers, const std::vector<SceneObject>& objects);
+
+// SCALAR BACKENDS
+// a structure of arrays copy of the sphere state that the step is templated over. Real is
+// float for the normal path or Fixed for bit exact replays across machines (keep the state
+// in SphereBodies<Fixed> between steps, converting back each step would lose determinism).
+// explicitly instantiated for float and Fixed in physics.cpp
+template <typename Real>
+struct SphereBodies {
+    std::vector<Real> px, py, pz;
+    std::vector<Real> vx, vy, vz;
+    std::vector<Real> radius;
+
+    size_t size() const { return px.size(); }
+};
+
+template <typename Real>
+SphereBodies<Real> loadSphereBodies(const std::vector<SceneObject>& objects);
+
+// writes positions and velocities back and rebuilds the model matrices for rendering
+template <typename Real>
+void storeSphereBodies(const SphereBodies<Real>& bodies, std::vector<SceneObject>& objects);
+
+// same step as updatePhysics (integration, walls, a single gauss-seidel contact pass) in Real
+template <typename Real>
+void stepSphereBodies(SphereBodies<Real>& bodies, float delta_time, const PhysicsParams& params);
+
+// an independent simulation with no rendering attached (mesh_data is left null)
+struct PhysicsWorld {
+    std::vector<SceneObject> objects;
+    PhysicsParams params;
+    TriggerSystem triggers; // updated after every step when it has volumes
+};
+
+PhysicsWorld createRandomWorld(uint32_t seed, int body_count, float radius, const PhysicsParams& params);
+
+// advances every world step_count times, each step identical to an updatePhysics call and
+// followed by updateTriggers for worlds with trigger volumes.
+// worlds with matching body counts are packed PHYSICS_BATCH_LANES at a time, one world
+// per simd lane, and the batches are spread over thread_count workers (0 = all cores).
+// stats are not recorded
+constexpr int PHYSICS_BATCH_LANES = 8;
+void stepPhysicsWorlds(std::vector<PhysicsWorld>& worlds, float delta_time, int step_count = 1, unsigned thread_count = 0);
+
+// stats of the most recent updatePhysics call (all zero when CONFIG::PHYSICS_STATS is off)
+const PhysicsStepStats& getPhysicsStats();
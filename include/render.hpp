@@ -0,0 +1,184 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstdint>
+#include <vector>
+
+// STREAMING
+// one persistently mapped buffer split into RING_FRAMES segments. each frame writes into
+// its own segment and fences it when done, so the cpu never overwrites data the gpu is
+// still reading. the buffer stays mapped for its whole life, there is no map/unmap per frame.
+// a frame that asks for more than a segment holds loses the allocations that don't fit, and
+// the next beginRingFrame waits for the gpu and reallocates the buffer big enough for it
+constexpr unsigned int RING_FRAMES = 3;
+
+typedef struct __GLsync* GLsync;
+
+struct RingAllocation {
+    void* data = nullptr; // nullptr when the frame's segment is full
+    unsigned int offset = 0; // from the start of the buffer, for binds and base instances
+    unsigned int size = 0;
+};
+
+struct RingBuffer {
+    unsigned int buffer = 0;
+    unsigned char* mapped = nullptr;
+    unsigned int frame_size = 0; // bytes per segment
+    unsigned int uniform_alignment = 256; // the larger of the uniform and storage buffer offset alignments
+    unsigned int frame = 0;
+    unsigned int head = 0; // bytes used in the current segment
+    unsigned int requested = 0; // what head would be if every allocation had fit
+    GLsync fences[RING_FRAMES] = {};
+};
+
+RingBuffer* createRingBuffer(unsigned int frame_size);
+void destroyRingBuffer(RingBuffer* ring);
+
+// moves to the next segment, waiting on its fence if the gpu has not finished with it.
+// returns true when the buffer was reallocated, bindings kept across frames (attachInstanceStream)
+// have to be redone
+bool beginRingFrame(RingBuffer* ring);
+// fences everything submitted since beginRingFrame
+void endRingFrame(RingBuffer* ring);
+
+// alignment must be a power of two no larger than the segment alignment (uniform_alignment)
+RingAllocation ringAllocate(RingBuffer* ring, unsigned int size, unsigned int alignment);
+
+// per instance data lives in the ring and is read by the vertex shader, the model matrix
+// at locations 3-6, the normal matrix at 7-9 (one column each) and the texture array layer
+// at 10. allocations are aligned to the instance size so a frame's instances are addressed
+// by base instance rather than by rebinding the buffer
+constexpr unsigned int INSTANCE_MODEL_LOCATION = 3;
+constexpr unsigned int INSTANCE_NORMAL_LOCATION = 7;
+constexpr unsigned int INSTANCE_TEXTURE_LOCATION = 10;
+
+struct InstanceData {
+    glm::mat4 model;
+    glm::vec4 normal_matrix[3]; // inverse transpose of the model's upper 3x3, w unused
+    uint32_t texture_layer; // layer in whichever texture array the draw binds
+    uint32_t padding[3]; // keeps the stride a power of two
+};
+static_assert(sizeof(InstanceData) == 128, "InstanceData stride must stay a power of two");
+
+struct InstanceRange {
+    unsigned int base_instance = 0;
+    unsigned int count = 0;
+};
+
+// writes every object's model_matrix straight into this frame's segment. with uniform_scale
+// the normal matrices are skipped, draws of them must use SHADER_VARIANT_UNIFORM_SCALE.
+// every instance of one upload samples the same texture_layer
+InstanceRange uploadInstances(RingBuffer* ring, const std::vector<SceneObject>& objects, bool uniform_scale, uint32_t texture_layer = 0);
+InstanceRange uploadInstances(RingBuffer* ring, const glm::mat4* matrices, unsigned int count, bool uniform_scale, uint32_t texture_layer = 0);
+// only the objects named by indices, in that order (e.g. the visible list from culling)
+InstanceRange uploadInstances(RingBuffer* ring, const std::vector<SceneObject>& objects, const std::vector<uint32_t>& indices, bool uniform_scale, uint32_t texture_layer = 0);
+
+// GEOMETRY POOL
+// every mesh lives in one vertex buffer and one index buffer, carved up by a first fit
+// offset allocator, and all of them share one vao. a whole pass is then a single
+// glMultiDrawElementsIndirect over a command array with no vao or buffer rebinds
+struct PoolRange {
+    unsigned int offset = 0;
+    unsigned int count = 0;
+};
+
+// free ranges are kept sorted by offset so neighbours can be merged when freed
+struct RangeAllocator {
+    unsigned int capacity = 0;
+    std::vector<PoolRange> free_ranges;
+};
+
+RangeAllocator createRangeAllocator(unsigned int capacity);
+bool allocateRange(RangeAllocator& allocator, unsigned int count, unsigned int& offset);
+void freeRange(RangeAllocator& allocator, unsigned int offset, unsigned int count);
+
+// every vertex is also stored as a bare position in position_vbo, at the same index, so the
+// depth pre-pass (depth_vao) reads 12 bytes per vertex instead of the full interleaved vertex.
+// both vaos share the index buffer and the instance stream, so draw commands work with either
+struct GeometryPool {
+    unsigned int vao = 0;
+    unsigned int vbo = 0;
+    unsigned int ibo = 0;
+    unsigned int depth_vao = 0;
+    unsigned int position_vbo = 0;
+    RangeAllocator vertices; // in vertices of CONFIG::VERTEX_LENGTH floats
+    RangeAllocator indices;
+};
+
+GeometryPool* createGeometryPool(unsigned int vertex_capacity, unsigned int index_capacity);
+void destroyGeometryPool(GeometryPool* pool);
+
+// copies interleaved vertices (position, normal, uv) and one index list per lod into the
+// pool and works out the mesh's bounding sphere. indices are relative to the mesh,
+// base_vertex offsets them at draw time
+Mesh* uploadMesh(GeometryPool* pool, const std::vector<float>& vertices, const std::vector<std::vector<unsigned int>>& lod_indices);
+
+// turns one vertex per triangle corner into unique vertices plus an index list. only corners
+// that match bit for bit (position, normal and uv) are merged, so seams stay intact
+void weldVertices(const std::vector<float>& corners, std::vector<float>& vertices, std::vector<unsigned int>& indices);
+
+// vertex clustering decimation. vertices snap to a grid over the bounds, starting at base_grid
+// cells across and halving, one existing vertex stands in for each cell and triangles that
+// collapse are dropped, so every level indexes the same vertex data. a grid that removes
+// nothing is skipped, and the chain ends when everything would collapse. element 0 is the input
+std::vector<std::vector<unsigned int>> buildLodChain(const std::vector<float>& vertices, const std::vector<unsigned int>& indices,
+                                                     int max_levels, int base_grid);
+void freeMesh(GeometryPool* pool, Mesh* mesh);
+
+// binds the ring as the pool's per instance attribute stream, see INSTANCE_MODEL_LOCATION
+void attachInstanceStream(GeometryPool* pool, const RingBuffer* ring);
+
+// layout fixed by the gl spec, do not reorder
+struct DrawElementsIndirectCommand {
+    unsigned int count;
+    unsigned int instance_count;
+    unsigned int first_index;
+    int base_vertex;
+    unsigned int base_instance;
+};
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "DrawElementsIndirectCommand must be tightly packed");
+
+DrawElementsIndirectCommand makeDrawCommand(const Mesh* mesh, const InstanceRange& instances, unsigned int lod = 0);
+
+// copies the commands into this frame's segment and issues them as one multi draw.
+// the pool's vao must be bound
+void submitDraws(RingBuffer* ring, const std::vector<DrawElementsIndirectCommand>& commands);
+
+// UNIFORM BLOCKS
+// mirrors of the std140 blocks in the shaders. std140 pads vec3 to 16 bytes, so
+// everything is stored as vec4 and the spare components carry extra scalars
+constexpr unsigned int FRAME_UNIFORM_BINDING = 0;
+constexpr unsigned int MATERIAL_UNIFORM_BINDING = 1;
+
+struct FrameUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 view_position;
+    glm::vec4 light_position;
+    glm::vec4 light_color;
+    glm::vec4 attenuation; // constant, linear, quadratic
+    glm::vec4 cluster_scale; // from clusterScale (lighting.hpp)
+};
+static_assert(sizeof(FrameUniforms) == 208, "FrameUniforms must match the std140 FrameData block");
+
+struct MaterialUniforms {
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular; // w is the shininess
+};
+static_assert(sizeof(MaterialUniforms) == 48, "MaterialUniforms must match the std140 MaterialData block");
+
+// writes the block into this frame's segment and binds it at FRAME_UNIFORM_BINDING
+void updateFrameUniforms(RingBuffer* ring, const FrameUniforms& values);
+
+// all materials in one immutable buffer, each at an offset aligned for glBindBufferRange.
+// materials are uploaded once and switched by index
+struct MaterialLibrary {
+    unsigned int ubo = 0;
+    unsigned int stride = 0;
+    unsigned int count = 0;
+};
+
+MaterialLibrary* createMaterialLibrary(const std::vector<MaterialUniforms>& materials);
+void destroyMaterialLibrary(MaterialLibrary* library);
+void bindMaterial(const MaterialLibrary* library, unsigned int index);
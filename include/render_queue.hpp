@@ -0,0 +1,83 @@
+#pragma once
+
+#include "gpu_profiler.hpp"
+#include "render.hpp"
+#include "shader.hpp"
+#include <cstdint>
+#include <vector>
+
+// RENDER QUEUE
+// draws are recorded in any order, each with a 64 bit sort key, radix sorted once per frame
+// and then walked in key order. gl state is only touched when it differs from the previous
+// item, and runs of items sharing all of it go out as one multi draw. key layout, most
+// significant bits first:
+//   pass 4 | program 8 | texture 8 | material 8 | mesh 16 | depth 20
+enum RenderPass : uint8_t {
+    RENDER_PASS_OPAQUE,
+    RENDER_PASS_WIREFRAME,
+    RENDER_PASS_COUNT
+};
+
+// must match the enum order, used to label gpu timings
+constexpr const char* RENDER_PASS_NAMES[RENDER_PASS_COUNT] = {
+    "opaque",
+    "wireframe",
+};
+
+struct RenderItem {
+    RenderPass pass = RENDER_PASS_OPAQUE;
+    ShaderVariant program = SHADER_VARIANT_DEFAULT;
+    unsigned int texture = 0; // texture array gl name, the instances pick their layer
+    unsigned int material = 0; // index into the MaterialLibrary
+    DrawElementsIndirectCommand command = {};
+};
+
+// how many times each kind of state would be set walking the items in some order
+struct RenderStateChanges {
+    uint32_t passes = 0;
+    uint32_t programs = 0;
+    uint32_t textures = 0;
+    uint32_t materials = 0;
+    uint32_t draw_calls = 0;
+};
+
+struct RenderQueueStats {
+    uint32_t items = 0;
+    RenderStateChanges unsorted; // submitting in recorded order
+    RenderStateChanges sorted; // what submitRenderQueue actually issued
+};
+
+struct RenderQueue {
+    std::vector<RenderItem> items;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> order;
+    RenderQueueStats stats;
+
+    // sort and batching scratch, kept to avoid allocating every frame
+    std::vector<uint64_t> scratch_keys;
+    std::vector<uint32_t> scratch_order;
+    std::vector<DrawElementsIndirectCommand> batch;
+};
+
+// depth is the view distance scaled to [0, 1] and is quantised to 20 bits, nearer first
+uint64_t makeSortKey(const RenderItem& item, unsigned int mesh_id, float depth);
+
+void clearRenderQueue(RenderQueue& queue);
+void pushRenderItem(RenderQueue& queue, const RenderItem& item, unsigned int mesh_id, float depth);
+
+// radix sorts by key and records the unsorted state change counts for comparison
+void sortRenderQueue(RenderQueue& queue);
+
+// DEPTH PRE-PASS
+// every opaque item of the sorted queue is drawn once, depth only, with a position only
+// program and one multi draw. the lit pass then tests GL_EQUAL with depth writes off, so its
+// fragment shader (and the light cluster loop in it) only runs for the visible surface.
+// the geometry pool's depth_vao must be bound
+void submitDepthPrepass(RenderQueue& queue, ShaderProgram* depth_program, RingBuffer* ring, GpuProfiler* profiler = nullptr);
+
+// walks the sorted items, skipping redundant binds. the geometry pool's vao must be bound.
+// with a profiler every pass is timed as its own gpu pass. depth_prepassed makes the opaque
+// pass test against the depth submitDepthPrepass left
+void submitRenderQueue(RenderQueue& queue, ShaderProgram* const programs[SHADER_VARIANT_COUNT],
+                       const MaterialLibrary* materials, RingBuffer* ring, GpuProfiler* profiler = nullptr,
+                       bool depth_prepassed = false);
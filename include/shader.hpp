@@ -0,0 +1,113 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// every loose uniform the engine's shaders declare. the enum value is the handle, so a set
+// in the frame loop is an array index plus one gl call, no string lookups. camera, light
+// and material state live in uniform blocks instead (see render.hpp)
+enum Uniform : uint8_t {
+    UNIFORM_RENDER_WIREFRAME,
+    UNIFORM_PRIMARY_TEXTURE,
+    UNIFORM_COUNT
+};
+
+// must match the enum order, these are the names glGetActiveUniform reports
+constexpr const char* UNIFORM_NAMES[UNIFORM_COUNT] = {
+    "render_wireframe",
+    "primary_texture",
+};
+
+// one set of sources compiles into several programs by switching #defines. the enum value
+// indexes the table below and whatever holds the compiled programs
+enum ShaderVariant : uint8_t {
+    SHADER_VARIANT_DEFAULT,
+    SHADER_VARIANT_UNIFORM_SCALE, // instances only rotate, translate and scale evenly, so normals use the model matrix
+    SHADER_VARIANT_COUNT
+};
+
+// must match the enum order
+const std::vector<std::string> SHADER_VARIANT_DEFINES[SHADER_VARIANT_COUNT] = {
+    {},
+    {"UNIFORM_SCALE"},
+};
+
+unsigned int getShaderType(const std::string& file_extension);
+std::string stringifyShaderSource(const std::string& file_path);
+// adds a #define per name straight after the #version line, with a #line so errors still
+// report the file's own line numbers
+std::string injectDefines(const std::string& source, const std::vector<std::string>& defines);
+// looks for KHR_parallel_shader_compile (or the ARB version) and tells the driver to compile
+// on its own threads. call once the context is current, with the loader glad was given
+void loadShaderCompilerExtensions(void* (*load)(const char* name));
+bool hasParallelShaderCompile();
+
+// a program whose compiles and link have been submitted but whose status hasn't been asked
+// for. asking forces the driver to finish, so everything waits for finishShaderProgram
+struct PendingShaderProgram {
+    unsigned int program = 0;
+    std::vector<unsigned int> shaders; // empty when the program came from the cache
+    std::vector<std::string> paths;
+    std::string folder;
+    uint64_t cache_key = 0;
+    bool retrievable = false;
+    float ms = 0.0f; // time spent submitting
+};
+
+// with CONFIG::SHADER_CACHE the linked binary is kept under SHADER_CACHE_PATH, keyed by a hash
+// of the sources (defines included) and the driver's vendor, renderer and version strings.
+// a missing, stale or rejected binary falls back to compiling
+PendingShaderProgram* beginShaderProgram(const std::string& shader_folder_path, const std::vector<std::string>& defines = {});
+// polls GL_COMPLETION_STATUS_KHR, always true without the extension
+bool isShaderProgramReady(const PendingShaderProgram* pending);
+// waits for the link, reports errors and frees pending. returns 0 if it failed
+unsigned int finishShaderProgram(PendingShaderProgram* pending);
+// drops a program that won't be finished and frees pending
+void cancelShaderProgram(PendingShaderProgram* pending);
+unsigned int createShaderProgram(const std::string& shader_folder_path, const std::vector<std::string>& defines = {});
+
+struct ShaderCacheStats {
+    unsigned int hits = 0;
+    unsigned int misses = 0;
+    float warm_ms = 0.0f; // total time creating programs from the cache
+    float cold_ms = 0.0f; // total time compiling and linking
+};
+
+const ShaderCacheStats& getShaderCacheStats();
+
+class ShaderProgram {
+public:
+    // compiles and links every shader in the folder with the given defines, then reflects
+    // the active uniforms. returns nullptr if nothing could be linked
+    static ShaderProgram* create(const std::string& shader_folder_path, const std::vector<std::string>& defines = {});
+    static ShaderProgram* create(const std::string& shader_folder_path, ShaderVariant variant);
+    // finishes a program started with beginShaderProgram
+    static ShaderProgram* create(PendingShaderProgram* pending);
+    ~ShaderProgram();
+
+    ShaderProgram(const ShaderProgram&) = delete;
+    ShaderProgram& operator=(const ShaderProgram&) = delete;
+
+    void use() const;
+    unsigned int id() const { return program; }
+
+    // -1 when the linked program doesn't use that uniform (gl ignores sets to -1)
+    int location(Uniform uniform) const { return locations[uniform]; }
+
+    // these write straight into the program (glProgramUniform*), it doesn't need to be bound
+    void set(Uniform uniform, int value) const;
+    void set(Uniform uniform, bool value) const;
+    void set(Uniform uniform, float value) const;
+    void set(Uniform uniform, const glm::vec3& value) const;
+    void set(Uniform uniform, const glm::mat4& value) const;
+
+private:
+    explicit ShaderProgram(unsigned int program);
+    void reflectUniforms();
+
+    unsigned int program;
+    std::array<int, UNIFORM_COUNT> locations;
+};
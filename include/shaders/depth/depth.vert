@@ -0,0 +1,23 @@
+#version 460 core
+// depth pre-pass, positions from the pool's position only stream and the instance model
+// matrix. gl_Position must come out bit identical to vertexShader.vert so the lit pass can
+// test GL_EQUAL against it: same inputs, same expression, both invariant
+layout (location = 0) in vec3 a_pos;
+layout (location = 3) in mat4 a_instance_model; // 3-6, one per instance
+
+layout (std140, binding = 0) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 view_position;
+    vec4 light_position;
+    vec4 light_color;
+    vec4 attenuation;
+    vec4 cluster_scale;
+};
+
+invariant gl_Position;
+
+void main() {
+    mat4 model_matrix = a_instance_model;
+    gl_Position = projection * view * model_matrix * vec4(a_pos, 1.0);
+}
@@ -2,23 +2,48 @@
 in vec3 frag_position;
 in vec3 normal;
 in vec2 tex_coords;
+flat in uint texture_layer;
 out vec4 frag_color;
 
-struct Material {
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    float shininess;
-}; 
-  
-uniform Material material;
-uniform vec3 light_position;
-uniform vec3 light_color;
-uniform vec3 view_position;
-uniform sampler2D primary_texture;
-uniform float constant_attenuation;
-uniform float linear_attenuation;
-uniform float quadratic_attenuation;
+layout (std140, binding = 0) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 view_position;
+    vec4 light_position;
+    vec4 light_color;
+    vec4 attenuation; // constant, linear, quadratic
+    vec4 cluster_scale; // pixels to tiles in xy, log(depth) to slice in zw
+};
+
+layout (std140, binding = 1) uniform MaterialData {
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular; // w is the shininess
+} material;
+
+// clustered point lights, grid size and bindings match lighting.hpp
+const uint CLUSTER_X = 16;
+const uint CLUSTER_Y = 9;
+const uint CLUSTER_Z = 24;
+
+struct PointLight {
+    vec4 position_radius;
+    vec4 color;
+};
+
+layout (std430, binding = 2) readonly buffer PointLights {
+    PointLight point_lights[];
+};
+
+layout (std430, binding = 3) readonly buffer LightClusters {
+    uvec2 light_clusters[]; // offset into light_indices, count
+};
+
+layout (std430, binding = 4) readonly buffer LightIndices {
+    uint light_indices[];
+};
+
+uniform sampler2DArray primary_texture;
 
 uniform bool render_wireframe;
 
@@ -29,26 +54,45 @@ void main()
         return;
     }
     
-    vec3 ambient = light_color * material.ambient;
+    vec3 ambient = light_color.rgb * material.ambient.rgb;
     
     vec3 norm = normalize(normal);
-    vec3 light_direction = normalize(light_position - frag_position);
+    vec3 light_direction = normalize(light_position.xyz - frag_position);
     
-    float distance = length(light_position - frag_position);
-    float attenuation = 1.0 / (
-        constant_attenuation +
-        linear_attenuation * distance + 
-        quadratic_attenuation * (distance * distance)
+    float distance = length(light_position.xyz - frag_position);
+    float falloff = 1.0 / (
+        attenuation.x +
+        attenuation.y * distance + 
+        attenuation.z * (distance * distance)
     );
     
     float diff = max(dot(norm, light_direction), 0.0);
-    vec3 diffuse = light_color * (diff * material.diffuse);
+    vec3 diffuse = light_color.rgb * (diff * material.diffuse.rgb);
  
-    vec3 view_direction = normalize(view_position - frag_position);
+    vec3 view_direction = normalize(view_position.xyz - frag_position);
     vec3 reflect_direction = reflect(-light_direction, norm);  
-    float spec = pow(max(dot(view_direction, reflect_direction), 0.0), material.shininess);
-    vec3 specular = light_color * (spec * material.specular);  
+    float spec = pow(max(dot(view_direction, reflect_direction), 0.0), material.specular.w);
+    vec3 specular = light_color.rgb * (spec * material.specular.rgb);  
     
-    vec3 result = ambient + (diffuse + specular) * attenuation;
-    frag_color = texture(primary_texture, tex_coords) * vec4(result, 1.0);
+    vec3 result = ambient + (diffuse + specular) * falloff;
+
+    float view_depth = -(view * vec4(frag_position, 1.0)).z;
+    uint slice = uint(clamp(log(view_depth) * cluster_scale.z + cluster_scale.w, 0.0, float(CLUSTER_Z - 1)));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy * cluster_scale.xy), uvec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    uvec2 cluster = light_clusters[tile.x + tile.y * CLUSTER_X + slice * CLUSTER_X * CLUSTER_Y];
+
+    for (uint i = 0; i < cluster.y; ++i) {
+        PointLight point = point_lights[light_indices[cluster.x + i]];
+        vec3 to_light = point.position_radius.xyz - frag_position;
+        float point_distance = length(to_light);
+        // smooth window so the light is exactly 0 at its radius, where culling cuts it off
+        float window = clamp(1.0 - pow(point_distance / point.position_radius.w, 4.0), 0.0, 1.0);
+        float point_falloff = window * window / (1.0 + point_distance * point_distance);
+
+        vec3 point_direction = to_light / max(point_distance, 1e-4);
+        float point_diff = max(dot(norm, point_direction), 0.0);
+        float point_spec = pow(max(dot(view_direction, reflect(-point_direction, norm)), 0.0), material.specular.w);
+        result += point.color.rgb * (point_diff * material.diffuse.rgb + point_spec * material.specular.rgb) * point_falloff;
+    }
+    frag_color = texture(primary_texture, vec3(tex_coords, float(texture_layer))) * vec4(result, 1.0);
 }
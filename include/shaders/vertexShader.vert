@@ -2,19 +2,39 @@
 layout (location = 0) in vec3 a_pos;
 layout (location = 1) in vec3 a_normal;
 layout (location = 2) in vec2 a_tex_coords;
+layout (location = 3) in mat4 a_instance_model; // 3-6, one per instance
+layout (location = 7) in mat3 a_instance_normal; // 7-9, not written for UNIFORM_SCALE draws
+layout (location = 10) in uint a_instance_texture_layer;
 
 
 out vec3 frag_position;
 out vec3 normal;
 out vec2 tex_coords;
+flat out uint texture_layer;
+// the depth pre-pass (depth/depth.vert) computes the same position, see there
+invariant gl_Position;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140, binding = 0) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 view_position;
+    vec4 light_position;
+    vec4 light_color;
+    vec4 attenuation; // constant, linear, quadratic
+    vec4 cluster_scale; // pixels to tiles in xy, log(depth) to slice in zw
+};
 
 void main() {
-    frag_position = vec3(model * vec4(a_pos, 1.0));
-    normal = mat3(transpose(inverse(model))) * a_normal;
+    mat4 model_matrix = a_instance_model;
+    frag_position = vec3(model_matrix * vec4(a_pos, 1.0));
+#ifdef UNIFORM_SCALE
+    // no shear or uneven scale, so the model matrix keeps normals perpendicular (the
+    // fragment shader renormalises)
+    normal = mat3(model_matrix) * a_normal;
+#else
+    normal = a_instance_normal * a_normal;
+#endif
     tex_coords = a_tex_coords;
-    gl_Position = projection * view * model * vec4(a_pos, 1.0);
+    texture_layer = a_instance_texture_layer;
+    gl_Position = projection * view * model_matrix * vec4(a_pos, 1.0);
 }
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// BLOCK COMPRESSION
+// textures are transcoded once into 4x4 block formats with a full mip chain built on the
+// cpu, and the result is cached under CONFIG::TEXTURE_CACHE_PATH so later runs read the
+// blocks and hand them to glCompressedTexSubImage directly. 3 channel images become BC1,
+// 4 channel BC3 and 1 channel BC4 (rgtc1). BC5 and BC7 are left out: nothing samples two
+// channel normal maps, so a normal map like Lamp_N.png stays BC1 and reads back as the colour
+// it is stored as, and a BC7 encoder is far more involved than these for the bundled assets
+
+// S3TC isn't core, so the generated glad doesn't have these
+constexpr unsigned int COMPRESSED_RGB_BC1 = 0x83F0; // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+constexpr unsigned int COMPRESSED_RGBA_BC3 = 0x83F3; // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+constexpr unsigned int COMPRESSED_RED_BC4 = 0x8DBB; // GL_COMPRESSED_RED_RGTC1
+
+struct CompressedImage {
+    unsigned int format = 0; // one of the above, 0 when empty
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> level_offsets; // levels + 1 entries into blocks, level 0 first
+    std::vector<unsigned char> blocks;
+};
+
+inline int compressedLevels(const CompressedImage& image) {
+    return static_cast<int>(image.level_offsets.size()) - 1;
+}
+
+// whether the driver takes S3TC uploads, needs the gl context
+bool hasTextureCompression();
+
+// tightly packed 8 bit pixels with 1, 3 or 4 channels. false for anything else
+bool compressImage(const unsigned char* pixels, int width, int height, int channels, CompressedImage& out);
+
+// the key covers the file's path, size and modification time plus the flip, so an edited
+// source misses and gets transcoded again
+uint64_t textureCacheKey(const std::filesystem::path& texture_path, bool upside_down);
+bool readTextureCache(uint64_t key, CompressedImage& out);
+void writeTextureCache(uint64_t key, const CompressedImage& image);
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "texture_compression.hpp"
+
+struct RingBuffer;
+
+// TEXTURE ARRAYS
+// textures with the same size and format share one GL_TEXTURE_2D_ARRAY, each in its own
+// layer. draws bind the array and every instance carries its layer (InstanceData), so meshes
+// with different textures still merge into one multi draw as long as their textures share
+// an array. everything samples through PRIMARY_TEXTURE_UNIT
+constexpr unsigned int PRIMARY_TEXTURE_UNIT = 0;
+
+struct TextureArray {
+    unsigned int texture = 0; // changes when the array grows
+    int width = 0;
+    int height = 0;
+    int levels = 0;
+    unsigned int internal_format = 0;
+    unsigned int layers = 0; // in use
+    unsigned int capacity = 0;
+};
+
+struct TextureSlot {
+    uint16_t array = 0; // index into TextureManager::arrays
+    uint16_t layer = 0;
+};
+
+// texture ids index slots. id 0 is a 1x1 white texture that stands in for anything that
+// failed to load
+struct TextureManager {
+    std::vector<TextureArray> arrays;
+    std::vector<TextureSlot> slots;
+    bool compress = false; // CONFIG::TEXTURE_COMPRESSION and the driver takes S3TC
+};
+
+constexpr unsigned int FALLBACK_TEXTURE = 0;
+
+TextureManager* createTextureManager();
+void destroyTextureManager(TextureManager* manager);
+
+// copies tightly packed 8 bit pixels (1, 3 or 4 channels) into a free layer and regenerates
+// that array's mips. returns the new texture id, or FALLBACK_TEXTURE if it couldn't be stored
+unsigned int addTexture(TextureManager* manager, const unsigned char* pixels, int width, int height, int channels);
+// every level of the image goes in as is, arrays of compressed formats hold only those
+unsigned int addCompressedTexture(TextureManager* manager, const CompressedImage& image);
+// decodes with stb_image and adds the result. when the manager compresses, the blocks come
+// from the texture cache instead, transcoded the first time
+unsigned int loadTexture(TextureManager* manager, const std::filesystem::path& texture_path, bool upside_down);
+
+inline const TextureSlot& textureSlot(const TextureManager* manager, unsigned int id) {
+    return manager->slots[id];
+}
+
+// the gl name to bind for a texture id, read again each frame since arrays can be reallocated
+// and streamed textures move off the placeholder
+inline unsigned int textureArrayName(const TextureManager* manager, unsigned int id) {
+    return manager->arrays[manager->slots[id].array].texture;
+}
+
+// ASYNC LOADING
+// worker threads decode images while the gl thread keeps running. each frame the gl thread
+// copies decoded pixels into a persistently mapped pixel unpack buffer (a RingBuffer, so a
+// segment is only reused once the gpu is done reading it) and uploads from there, stopping
+// at CONFIG::TEXTURE_UPLOAD_BUDGET bytes. until then the texture's id shows the fallback
+struct TextureRequest {
+    unsigned int id = 0;
+    std::filesystem::path path;
+    bool upside_down = false;
+    bool compress = false;
+};
+
+struct DecodedTexture {
+    unsigned int id = 0;
+    unsigned char* pixels = nullptr; // nullptr when decoding failed, the id keeps the fallback
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    CompressedImage compressed; // filled instead of pixels for compressed requests
+};
+
+struct TextureLoader {
+    std::vector<std::thread> workers;
+    std::mutex mutex; // guards everything down to stopping
+    std::condition_variable wake;
+    std::deque<TextureRequest> requests;
+    std::deque<DecodedTexture> decoded;
+    bool stopping = false;
+
+    RingBuffer* staging = nullptr;
+    unsigned int in_flight = 0; // requested but not uploaded yet, gl thread only
+};
+
+// thread_count 0 uses half the hardware threads
+TextureLoader* createTextureLoader(unsigned int thread_count = 0);
+// drops whatever hasn't been uploaded yet
+void destroyTextureLoader(TextureLoader* loader);
+
+// returns the id straight away, it samples FALLBACK_TEXTURE until its upload lands
+unsigned int requestTexture(TextureManager* manager, TextureLoader* loader, const std::filesystem::path& texture_path, bool upside_down);
+// once per frame on the gl thread, returns how many textures became resident
+unsigned int updateTextureLoader(TextureLoader* loader, TextureManager* manager);
+
+inline bool texturesPending(const TextureLoader* loader) {
+    return loader->in_flight > 0;
+}
@@ -7,10 +7,28 @@ struct RGBA {
     float r, g, b, a;
 };
 
+constexpr int MAX_MESH_LODS = 4;
+
+// one level of detail, a sub range of the mesh's indices over the same vertices
+struct MeshLod {
+    unsigned int first_index = 0;
+    unsigned int index_count = 0;
+};
+
+// a mesh is just its slice of the shared geometry pool (see render.hpp), every mesh
+// uses the same vao and buffers. first_index/index_count cover every lod together
 struct Mesh {
-    unsigned int vao = 0;
-    unsigned int vbo = 0;
+    unsigned int base_vertex = 0;
     unsigned int vertex_count = 0;
+    unsigned int first_index = 0;
+    unsigned int index_count = 0;
+
+    MeshLod lods[MAX_MESH_LODS]; // 0 is the full mesh
+    unsigned int lod_count = 1;
+
+    // mesh space bounding sphere, filled in when the mesh is loaded
+    glm::vec3 bounds_center = glm::vec3(0.0f);
+    float bounds_radius = 0.0f;
 };
 
 // trying to structure it kind of like how most game engines do it
@@ -5,6 +5,7 @@
 #include <glm/ext/quaternion_geometric.hpp>
 #include <glm/fwd.hpp>
 #include <glm/geometric.hpp>
+#include <glm/glm.hpp>
 
 template <typename T>
 T min(T a, T b) {
@@ -33,4 +34,13 @@ T lerp(const T& a, const T& b, float t) {
 
 glm::vec3 midpoint(glm::vec3 a, glm::vec3 b);
 
+// planes are (normal, distance) with normals pointing inwards, in the order
+// left, right, bottom, top, near, far
+struct Frustum {
+  glm::vec4 planes[6];
+};
+
+Frustum extractFrustum(const glm::mat4& view_projection);
+bool sphereInFrustum(const Frustum& frustum, const glm::vec3& center, float radius);
+
 #endif // !UTILITIES_HPP
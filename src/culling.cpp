@@ -0,0 +1,168 @@
+#include "../include/culling.hpp"
+#include "../include/config.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CULLING_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace {
+    // writes surviving indices to out, returns how many
+    unsigned int cullSpheresScalar(const Frustum& frustum, const CullSpheres& spheres, uint32_t* out) {
+        unsigned int visible = 0;
+        for (unsigned int i = 0; i < spheres.count; ++i) {
+            bool inside = true;
+            for (const auto& plane : frustum.planes) {
+                float distance = plane.x * spheres.x[i] + plane.y * spheres.y[i] + plane.z * spheres.z[i] + plane.w;
+                inside &= distance >= -spheres.radius[i];
+            }
+            out[visible] = i;
+            visible += inside;
+        }
+        return visible;
+    }
+
+#ifdef CULLING_AVX2
+    // same test as the scalar path, CULL_LANES spheres per iteration. the padding lanes have
+    // a huge negative radius so they always fail and the loop needs no tail
+    __attribute__((target("avx2,fma")))
+    unsigned int cullSpheresAvx2(const Frustum& frustum, const CullSpheres& spheres, uint32_t* out) {
+        __m256 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+        for (int p = 0; p < 6; ++p) {
+            plane_x[p] = _mm256_set1_ps(frustum.planes[p].x);
+            plane_y[p] = _mm256_set1_ps(frustum.planes[p].y);
+            plane_z[p] = _mm256_set1_ps(frustum.planes[p].z);
+            plane_w[p] = _mm256_set1_ps(frustum.planes[p].w);
+        }
+
+        const __m256 sign_bit = _mm256_set1_ps(-0.0f);
+        unsigned int visible = 0;
+        for (unsigned int base = 0; base < spheres.count; base += CULL_LANES) {
+            __m256 x = _mm256_loadu_ps(spheres.x.data() + base);
+            __m256 y = _mm256_loadu_ps(spheres.y.data() + base);
+            __m256 z = _mm256_loadu_ps(spheres.z.data() + base);
+            __m256 negative_radius = _mm256_xor_ps(_mm256_loadu_ps(spheres.radius.data() + base), sign_bit);
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p) {
+                __m256 distance = _mm256_fmadd_ps(plane_x[p], x, plane_w[p]);
+                distance = _mm256_fmadd_ps(plane_y[p], y, distance);
+                distance = _mm256_fmadd_ps(plane_z[p], z, distance);
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negative_radius, _CMP_GE_OQ));
+            }
+
+            unsigned int mask = static_cast<unsigned int>(_mm256_movemask_ps(inside));
+            while (mask) {
+                out[visible++] = base + static_cast<unsigned int>(__builtin_ctz(mask));
+                mask &= mask - 1;
+            }
+        }
+        return visible;
+    }
+
+    bool detectAvx2() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+#endif
+
+    // projected pixel radius below which level `level` (>= 1) takes over from level - 1
+    float lodSwitchRadius(unsigned int level) {
+        return CONFIG::MESH_LOD_SWITCH_RADIUS / static_cast<float>(1u << (level - 1));
+    }
+
+    // moves at most as far as the radius says, but only past a boundary once it is
+    // MESH_LOD_HYSTERESIS beyond it, so a sphere sitting on a boundary doesn't flicker
+    unsigned int chooseLod(unsigned int current, float pixel_radius, unsigned int lod_count) {
+        const float h = CONFIG::MESH_LOD_HYSTERESIS;
+        unsigned int lod = std::min(current, lod_count - 1);
+        while (lod + 1 < lod_count && pixel_radius < lodSwitchRadius(lod + 1) * (1.0f - h)) ++lod;
+        while (lod > 0 && pixel_radius > lodSwitchRadius(lod) * (1.0f + h)) --lod;
+        return lod;
+    }
+}
+
+void gatherCullSpheres(const std::vector<SceneObject>& objects, CullSpheres& spheres) {
+    spheres.count = static_cast<unsigned int>(objects.size());
+    size_t padded = (objects.size() + CULL_LANES - 1) / CULL_LANES * CULL_LANES;
+    spheres.x.assign(padded, 0.0f);
+    spheres.y.assign(padded, 0.0f);
+    spheres.z.assign(padded, 0.0f);
+    spheres.radius.assign(padded, -std::numeric_limits<float>::max());
+
+    for (size_t i = 0; i < objects.size(); ++i) {
+        const SceneObject& obj = objects[i];
+        if (!obj.mesh_data) {
+            spheres.x[i] = obj.position.x;
+            spheres.y[i] = obj.position.y;
+            spheres.z[i] = obj.position.z;
+            spheres.radius[i] = obj.radius;
+            continue;
+        }
+
+        // the largest axis scale bounds the radius under any non-uniform scale
+        const glm::mat4& model = obj.model_matrix;
+        glm::vec4 center = model * glm::vec4(obj.mesh_data->bounds_center, 1.0f);
+        float scale_squared = max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                              max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])),
+                                  glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+        spheres.x[i] = center.x;
+        spheres.y[i] = center.y;
+        spheres.z[i] = center.z;
+        spheres.radius[i] = obj.mesh_data->bounds_radius * std::sqrt(scale_squared);
+    }
+}
+
+bool cullingUsesAvx2() {
+#ifdef CULLING_AVX2
+    static const bool has_avx2 = detectAvx2();
+    return has_avx2;
+#else
+    return false;
+#endif
+}
+
+LodView makeLodView(const glm::vec3& camera_position, float fov_degrees, int viewport_height) {
+    LodView view;
+    view.camera_position = camera_position;
+    view.pixels_per_unit = static_cast<float>(viewport_height) / (2.0f * std::tan(glm::radians(fov_degrees) * 0.5f));
+    return view;
+}
+
+void cullSpheresLod(const Frustum& frustum, const CullSpheres& spheres, const LodView& view, unsigned int lod_count,
+                    std::vector<uint8_t>& lods, std::vector<uint32_t>& visible, std::vector<uint32_t> buckets[MAX_MESH_LODS]) {
+    for (int lod = 0; lod < MAX_MESH_LODS; ++lod) buckets[lod].clear();
+    lods.resize(spheres.count, 0);
+    cullSpheres(frustum, spheres, visible);
+
+    lod_count = std::max(1u, std::min<unsigned int>(lod_count, MAX_MESH_LODS));
+    for (uint32_t i : visible) {
+        float dx = spheres.x[i] - view.camera_position.x;
+        float dy = spheres.y[i] - view.camera_position.y;
+        float dz = spheres.z[i] - view.camera_position.z;
+        // inside the sphere counts as filling the screen
+        float distance = std::max(std::sqrt(dx * dx + dy * dy + dz * dz), 1e-4f);
+        float pixel_radius = spheres.radius[i] * view.pixels_per_unit / distance;
+
+        unsigned int lod = chooseLod(lods[i], pixel_radius, lod_count);
+        lods[i] = static_cast<uint8_t>(lod);
+        buckets[lod].push_back(i);
+    }
+}
+
+unsigned int cullSpheres(const Frustum& frustum, const CullSpheres& spheres, std::vector<uint32_t>& visible) {
+    visible.resize(spheres.x.size());
+    unsigned int count = 0;
+#ifdef CULLING_AVX2
+    if (cullingUsesAvx2()) count = cullSpheresAvx2(frustum, spheres, visible.data());
+    else count = cullSpheresScalar(frustum, spheres, visible.data());
+#else
+    count = cullSpheresScalar(frustum, spheres, visible.data());
+#endif
+    visible.resize(count);
+    return count;
+}
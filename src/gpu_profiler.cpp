@@ -0,0 +1,140 @@
+#include "../include/glad/glad.h"
+#include "../include/gpu_profiler.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+    GpuPassTiming& timingFor(GpuProfiler* profiler, const char* name) {
+        for (GpuPassTiming& timing : profiler->timings) {
+            if (timing.name == name || std::strcmp(timing.name, name) == 0) return timing;
+        }
+        profiler->timings.emplace_back();
+        profiler->timings.back().name = name;
+        return profiler->timings.back();
+    }
+
+    void recordTiming(GpuPassTiming& timing, float ms) {
+        timing.last_ms = ms;
+        timing.history[timing.history_cursor] = ms;
+        timing.history_cursor = (timing.history_cursor + 1) % GPU_PROFILER_AVERAGE_FRAMES;
+        if (timing.history_count < GPU_PROFILER_AVERAGE_FRAMES) ++timing.history_count;
+
+        float total = 0.0f;
+        for (int i = 0; i < timing.history_count; ++i) total += timing.history[i];
+        timing.average_ms = total / static_cast<float>(timing.history_count);
+    }
+
+    void readBackFrame(GpuProfiler* profiler, GpuProfilerFrame& frame) {
+        if (!frame.pending) return;
+        frame.pending = false;
+
+        if (frame.fragments_counted) {
+            GLint available = 0;
+            glGetQueryObjectiv(frame.fragment_query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 invocations = 0;
+                glGetQueryObjectui64v(frame.fragment_query, GL_QUERY_RESULT, &invocations);
+                profiler->fragment_invocations = invocations;
+            }
+        }
+        if (frame.pass_count == 0) return;
+
+        // reading a result that isn't ready would block, so the whole frame is dropped instead
+        for (int pass = 0; pass < frame.pass_count; ++pass) {
+            GLint available = 0;
+            glGetQueryObjectiv(frame.queries[pass][1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                ++profiler->dropped_frames;
+                return;
+            }
+        }
+
+        for (int pass = 0; pass < frame.pass_count; ++pass) {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(frame.queries[pass][0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(frame.queries[pass][1], GL_QUERY_RESULT, &end);
+            recordTiming(timingFor(profiler, frame.names[pass]), static_cast<float>(end - begin) / 1.0e6f);
+        }
+    }
+}
+
+GpuProfiler* createGpuProfiler() {
+    GpuProfiler* profiler = new GpuProfiler();
+    for (GpuProfilerFrame& frame : profiler->frames) {
+        glGenQueries(GPU_PROFILER_MAX_PASSES * 2, &frame.queries[0][0]);
+        glGenQueries(1, &frame.fragment_query);
+    }
+    return profiler;
+}
+
+void destroyGpuProfiler(GpuProfiler* profiler) {
+    for (GpuProfilerFrame& frame : profiler->frames) {
+        glDeleteQueries(GPU_PROFILER_MAX_PASSES * 2, &frame.queries[0][0]);
+        glDeleteQueries(1, &frame.fragment_query);
+    }
+    delete profiler;
+}
+
+void beginGpuFrame(GpuProfiler* profiler) {
+    profiler->frame = (profiler->frame + 1) % GPU_PROFILER_LATENCY;
+    GpuProfilerFrame& frame = profiler->frames[profiler->frame];
+    readBackFrame(profiler, frame);
+
+    frame.pass_count = 0;
+    frame.fragments_counted = false;
+    frame.pending = true;
+    profiler->open_count = 0;
+    profiler->dropped_opens = 0;
+}
+
+void beginGpuPass(GpuProfiler* profiler, const char* name) {
+    GpuProfilerFrame& frame = profiler->frames[profiler->frame];
+    // once one is dropped everything nested in it is too, so the ends can pay those back first
+    if (profiler->dropped_opens > 0 || frame.pass_count >= GPU_PROFILER_MAX_PASSES || profiler->open_count >= GPU_PROFILER_MAX_PASSES) {
+        ++profiler->dropped_opens;
+        return;
+    }
+
+    int pass = frame.pass_count++;
+    frame.names[pass] = name;
+    glQueryCounter(frame.queries[pass][0], GL_TIMESTAMP);
+    profiler->open_passes[profiler->open_count++] = pass;
+}
+
+void endGpuPass(GpuProfiler* profiler) {
+    if (profiler->dropped_opens > 0) {
+        --profiler->dropped_opens;
+        return;
+    }
+    if (profiler->open_count == 0) return;
+    GpuProfilerFrame& frame = profiler->frames[profiler->frame];
+    int pass = profiler->open_passes[--profiler->open_count];
+    glQueryCounter(frame.queries[pass][1], GL_TIMESTAMP);
+}
+
+void beginFragmentCount(GpuProfiler* profiler) {
+    GpuProfilerFrame& frame = profiler->frames[profiler->frame];
+    if (frame.fragments_counted || profiler->counting_fragments) return;
+    glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS, frame.fragment_query);
+    frame.fragments_counted = true;
+    profiler->counting_fragments = true;
+}
+
+void endFragmentCount(GpuProfiler* profiler) {
+    if (!profiler->counting_fragments) return;
+    glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS);
+    profiler->counting_fragments = false;
+}
+
+std::string formatGpuTimings(const GpuProfiler* profiler) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    for (const GpuPassTiming& timing : profiler->timings) {
+        out << timing.name << " " << timing.average_ms << "ms ";
+    }
+    if (profiler->fragment_invocations) out << "fragments " << profiler->fragment_invocations << " ";
+    return out.str();
+}
@@ -0,0 +1,120 @@
+#include "../include/glad/glad.h"
+#include "../include/headless.hpp"
+#include "../include/shader.hpp"
+
+#include <iostream>
+
+#ifdef ENGINE_HAS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+namespace {
+    EGLDisplay openSurfacelessDisplay() {
+        auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (get_platform_display) {
+            EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY) return display;
+        }
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    // 4.6 is what the shaders are written for, 4.5 is as far as some llvmpipe builds go. the
+    // shader loader lowers #version to whatever the context reports
+    EGLContext createCoreContext(EGLDisplay display) {
+        const EGLint versions[][2] = {{4, 6}, {4, 5}};
+        for (const auto& version : versions) {
+            const EGLint attributes[] = {
+                EGL_CONTEXT_MAJOR_VERSION, version[0],
+                EGL_CONTEXT_MINOR_VERSION, version[1],
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                EGL_NONE
+            };
+            EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+            if (context != EGL_NO_CONTEXT) {
+                if (version[1] < 6) std::cout << "headless: using a GL " << version[0] << "." << version[1] << " core context" << "\n";
+                return context;
+            }
+        }
+        return EGL_NO_CONTEXT;
+    }
+}
+
+HeadlessContext* createHeadlessContext(int width, int height) {
+    EGLDisplay display = openSurfacelessDisplay();
+    EGLint major = 0, minor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        std::cerr << "headless: failed to initialise an EGL display" << "\n";
+        return nullptr;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "headless: EGL has no desktop GL support" << "\n";
+        eglTerminate(display);
+        return nullptr;
+    }
+
+    EGLContext context = createCoreContext(display);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cerr << "headless: failed to create a GL core context (0x" << std::hex << eglGetError() << std::dec << ")" << "\n";
+        if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+        eglTerminate(display);
+        return nullptr;
+    }
+
+    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress))) {
+        std::cerr << "Failed to initialise GLAD" << "\n";
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+        return nullptr;
+    }
+    loadShaderCompilerExtensions(reinterpret_cast<GLADloadproc>(eglGetProcAddress));
+
+    HeadlessContext* headless = new HeadlessContext();
+    headless->display = display;
+    headless->context = context;
+    headless->width = width;
+    headless->height = height;
+
+    // surfaceless contexts have no default framebuffer, everything draws into this one
+    glCreateRenderbuffers(1, &headless->color);
+    glNamedRenderbufferStorage(headless->color, GL_RGBA8, width, height);
+    glCreateRenderbuffers(1, &headless->depth);
+    glNamedRenderbufferStorage(headless->depth, GL_DEPTH24_STENCIL8, width, height);
+    glCreateFramebuffers(1, &headless->framebuffer);
+    glNamedFramebufferRenderbuffer(headless->framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headless->color);
+    glNamedFramebufferRenderbuffer(headless->framebuffer, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, headless->depth);
+    if (glCheckNamedFramebufferStatus(headless->framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "headless: offscreen framebuffer is incomplete" << "\n";
+        destroyHeadlessContext(headless);
+        return nullptr;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, headless->framebuffer);
+    glViewport(0, 0, width, height);
+    std::cout << "headless: " << glGetString(GL_VERSION) << " on " << glGetString(GL_RENDERER) << std::endl;
+    return headless;
+}
+
+void destroyHeadlessContext(HeadlessContext* headless) {
+    glDeleteFramebuffers(1, &headless->framebuffer);
+    glDeleteRenderbuffers(1, &headless->color);
+    glDeleteRenderbuffers(1, &headless->depth);
+
+    EGLDisplay display = static_cast<EGLDisplay>(headless->display);
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, static_cast<EGLContext>(headless->context));
+    eglTerminate(display);
+    delete headless;
+}
+
+#else
+
+HeadlessContext* createHeadlessContext([[maybe_unused]] int width, [[maybe_unused]] int height) {
+    std::cerr << "headless: this build has no EGL support (install the EGL development files and reconfigure)" << "\n";
+    return nullptr;
+}
+
+void destroyHeadlessContext(HeadlessContext* headless) {
+    delete headless;
+}
+
+#endif
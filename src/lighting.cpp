@@ -0,0 +1,176 @@
+#include "../include/glad/glad.h"
+#include "../include/lighting.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    float sliceDepth(int slice, float near_plane, float far_plane) {
+        return near_plane * std::pow(far_plane / near_plane, static_cast<float>(slice) / CLUSTER_Z);
+    }
+
+    // corners of every tile at the near and far depth of its slice, unprojected with the
+    // projection's x and y scale. view space looks down -z
+    void buildClusterBounds(LightClusters& clusters, const glm::mat4& projection, float near_plane, float far_plane) {
+        clusters.bounds_min.resize(CLUSTER_COUNT);
+        clusters.bounds_max.resize(CLUSTER_COUNT);
+        const float inverse_scale_x = 1.0f / projection[0][0];
+        const float inverse_scale_y = 1.0f / projection[1][1];
+
+        for (int slice = 0; slice < CLUSTER_Z; ++slice) {
+            const float depths[2] = {sliceDepth(slice, near_plane, far_plane), sliceDepth(slice + 1, near_plane, far_plane)};
+            for (int tile_y = 0; tile_y < CLUSTER_Y; ++tile_y) {
+                const float ndc_y[2] = {-1.0f + 2.0f * tile_y / CLUSTER_Y, -1.0f + 2.0f * (tile_y + 1) / CLUSTER_Y};
+                for (int tile_x = 0; tile_x < CLUSTER_X; ++tile_x) {
+                    const float ndc_x[2] = {-1.0f + 2.0f * tile_x / CLUSTER_X, -1.0f + 2.0f * (tile_x + 1) / CLUSTER_X};
+
+                    glm::vec3 low(INFINITY), high(-INFINITY);
+                    for (float depth : depths) {
+                        for (float nx : ndc_x) {
+                            for (float ny : ndc_y) {
+                                glm::vec3 corner(nx * depth * inverse_scale_x, ny * depth * inverse_scale_y, -depth);
+                                low = glm::min(low, corner);
+                                high = glm::max(high, corner);
+                            }
+                        }
+                    }
+                    const int cluster = tile_x + tile_y * CLUSTER_X + slice * CLUSTER_X * CLUSTER_Y;
+                    clusters.bounds_min[cluster] = low;
+                    clusters.bounds_max[cluster] = high;
+                }
+            }
+        }
+    }
+
+    // sphere against box for LIGHT_LANES lights at once, straight line so it vectorises.
+    // padding lanes have a negative radius and never hit
+    void overlapLanes(const float* __restrict x, const float* __restrict y, const float* __restrict z, const float* __restrict radius,
+                      const glm::vec3& low, const glm::vec3& high, uint8_t* __restrict hits) {
+        for (int l = 0; l < LIGHT_LANES; ++l) {
+            float dx = std::max(std::max(low.x - x[l], x[l] - high.x), 0.0f);
+            float dy = std::max(std::max(low.y - y[l], y[l] - high.y), 0.0f);
+            float dz = std::max(std::max(low.z - z[l], z[l] - high.z), 0.0f);
+            hits[l] = (dx * dx + dy * dy + dz * dz <= radius[l] * radius[l]) & (radius[l] >= 0.0f);
+        }
+    }
+
+    void clearLanes(LightLanes& lanes) {
+        lanes.x.clear();
+        lanes.y.clear();
+        lanes.z.clear();
+        lanes.radius.clear();
+        lanes.ids.clear();
+    }
+
+    void padLanes(LightLanes& lanes) {
+        const size_t padded = (lanes.ids.size() + LIGHT_LANES - 1) / LIGHT_LANES * LIGHT_LANES;
+        lanes.x.resize(padded, 0.0f);
+        lanes.y.resize(padded, 0.0f);
+        lanes.z.resize(padded, 0.0f);
+        lanes.radius.resize(padded, -1.0f);
+    }
+
+    // calls hit(lane index) for every light in source touching the box
+    template <typename OnHit>
+    void forEachOverlap(const LightLanes& source, const glm::vec3& low, const glm::vec3& high, OnHit hit) {
+        alignas(32) uint8_t hits[LIGHT_LANES];
+        for (size_t batch = 0; batch < source.x.size(); batch += LIGHT_LANES) {
+            overlapLanes(&source.x[batch], &source.y[batch], &source.z[batch], &source.radius[batch], low, high, hits);
+            for (int l = 0; l < LIGHT_LANES; ++l) {
+                if (hits[l]) hit(batch + l);
+            }
+        }
+    }
+
+    // the lights of source touching the box, as a padded set of their own
+    void filterLanes(const LightLanes& source, const glm::vec3& low, const glm::vec3& high, LightLanes& out) {
+        clearLanes(out);
+        forEachOverlap(source, low, high, [&](size_t i) {
+            out.x.push_back(source.x[i]);
+            out.y.push_back(source.y[i]);
+            out.z.push_back(source.z[i]);
+            out.radius.push_back(source.radius[i]);
+            out.ids.push_back(source.ids[i]);
+        });
+        padLanes(out);
+    }
+
+    void boundsOf(const LightClusters& clusters, int first, int count, glm::vec3& low, glm::vec3& high) {
+        low = glm::vec3(INFINITY);
+        high = glm::vec3(-INFINITY);
+        for (int cluster = first; cluster < first + count; ++cluster) {
+            low = glm::min(low, clusters.bounds_min[cluster]);
+            high = glm::max(high, clusters.bounds_max[cluster]);
+        }
+    }
+}
+
+glm::vec4 clusterScale(float near_plane, float far_plane, int width, int height) {
+    const float slices_per_log = CLUSTER_Z / std::log(far_plane / near_plane);
+    return glm::vec4(static_cast<float>(CLUSTER_X) / width, static_cast<float>(CLUSTER_Y) / height,
+                     slices_per_log, -std::log(near_plane) * slices_per_log);
+}
+
+void buildLightClusters(LightClusters& clusters, const std::vector<PointLight>& lights,
+                        const glm::mat4& projection, const glm::mat4& view, float near_plane, float far_plane) {
+    buildClusterBounds(clusters, projection, near_plane, far_plane);
+
+    LightLanes& all = clusters.lights;
+    clearLanes(all);
+    for (size_t i = 0; i < lights.size(); ++i) {
+        glm::vec4 position = view * glm::vec4(glm::vec3(lights[i].position_radius), 1.0f);
+        all.x.push_back(position.x);
+        all.y.push_back(position.y);
+        all.z.push_back(position.z);
+        all.radius.push_back(lights[i].position_radius.w);
+        all.ids.push_back(static_cast<uint32_t>(i));
+    }
+    padLanes(all);
+
+    clusters.ranges.assign(CLUSTER_COUNT * 2, 0);
+    clusters.indices.clear();
+    clusters.stats = {};
+    clusters.stats.lights = static_cast<uint32_t>(lights.size());
+
+    constexpr int SLICE_CLUSTERS = CLUSTER_X * CLUSTER_Y;
+    glm::vec3 low, high;
+    for (int slice = 0; slice < CLUSTER_Z; ++slice) {
+        boundsOf(clusters, slice * SLICE_CLUSTERS, SLICE_CLUSTERS, low, high);
+        filterLanes(all, low, high, clusters.slice);
+        if (clusters.slice.ids.empty()) continue;
+
+        for (int tile_y = 0; tile_y < CLUSTER_Y; ++tile_y) {
+            const int row_start = slice * SLICE_CLUSTERS + tile_y * CLUSTER_X;
+            boundsOf(clusters, row_start, CLUSTER_X, low, high);
+            filterLanes(clusters.slice, low, high, clusters.row);
+            if (clusters.row.ids.empty()) continue;
+
+            for (int cluster = row_start; cluster < row_start + CLUSTER_X; ++cluster) {
+                const uint32_t first = static_cast<uint32_t>(clusters.indices.size());
+                forEachOverlap(clusters.row, clusters.bounds_min[cluster], clusters.bounds_max[cluster],
+                               [&](size_t i) { clusters.indices.push_back(clusters.row.ids[i]); });
+
+                const uint32_t light_count = static_cast<uint32_t>(clusters.indices.size()) - first;
+                clusters.ranges[cluster * 2] = first;
+                clusters.ranges[cluster * 2 + 1] = light_count;
+                clusters.stats.max_per_cluster = std::max(clusters.stats.max_per_cluster, light_count);
+            }
+        }
+    }
+    clusters.stats.references = static_cast<uint32_t>(clusters.indices.size());
+}
+
+void uploadLightClusters(RingBuffer* ring, const LightClusters& clusters, const std::vector<PointLight>& lights) {
+    // empty buffers still get a binding, a zero sized range isn't allowed
+    auto upload = [&](unsigned int binding, const void* data, size_t size) {
+        const unsigned int bytes = static_cast<unsigned int>(std::max<size_t>(size, 16));
+        RingAllocation allocation = ringAllocate(ring, bytes, ring->uniform_alignment);
+        if (!allocation.data) return;
+        if (size) std::memcpy(allocation.data, data, size);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, ring->buffer, allocation.offset, bytes);
+    };
+    upload(POINT_LIGHT_BINDING, lights.data(), lights.size() * sizeof(PointLight));
+    upload(LIGHT_CLUSTER_BINDING, clusters.ranges.data(), clusters.ranges.size() * sizeof(uint32_t));
+    upload(LIGHT_INDEX_BINDING, clusters.indices.data(), clusters.indices.size() * sizeof(uint32_t));
+}
@@ -11,6 +11,8 @@
 #include "../include/stb_image.h"
 #include "../include/ufbx.h"
 
+#include <charconv>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
 #include <fstream>
@@ -19,26 +21,25 @@
 #include <string>
 #include <random>
 #include <algorithm>
+#include <chrono>
 
 #include "../include/config.hpp"
 #include "../include/types.hpp"
+#include "../include/physics.hpp"
+#include "../include/render.hpp"
+#include "../include/render_queue.hpp"
+#include "../include/shader.hpp"
+#include "../include/culling.hpp"
+#include "../include/headless.hpp"
+#include "../include/textures.hpp"
+#include "../include/lighting.hpp"
+#include "../include/occlusion.hpp"
 
 void GLAPIENTRY messageCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam);
 
-GLenum getShaderType(const std::string& file_extension);
-std::string stringifyShaderSource(const std::string& file_path);
-unsigned int compileShader(const std::string& source, GLenum shader_type);
-unsigned int createShaderProgram(const std::string& shader_folder_path);
-void setInt(unsigned int shader_program, const std::string& name, int value);
-void setBool(unsigned int shader_program, const std::string& name, bool value);
-void setFloat(unsigned int shader_program, const std::string& name, float value);
-void setMat4(unsigned int shader_program, const std::string& name, const glm::mat4& value);
-void setVec3(unsigned int shader_program, const std::string& name, const glm::vec3& value);
-
-unsigned int loadTexture(const std::filesystem::path& texture_path, bool upside_down);
-
 std::vector<float> readFBXFile(const std::string& file_path);
-Mesh* generateMesh(const std::vector<float>& vertices);
+Mesh* generateMesh(GeometryPool* pool, const std::vector<float>& vertices, const std::string& name);
+OccluderMesh generateOccluderMesh(const std::vector<float>& vertices);
 
 GLFWwindow* createWindow(UserState* user);
 void framebufferSizeCallback(GLFWwindow* window, int width, int height);
@@ -76,211 +77,467 @@ SceneObject createIcosphere(Mesh* sphere_mesh, float radius) {
     return sphere;
 }
 
-void updatePhysics(std::vector<SceneObject>& objects, float delta_time) {
-    const float BOX_HALF_SIZE = CONFIG::BOX_SIZE / 2.0f;
-    const float MAX_VELOCITY = CONFIG::ICOSPHERE_MAX_START_VELOCITY * 3.0f; // in case of runaway
-    const float DAMPING = 1.0f; // no elasticity
-    const float RESTITUTION = 1.0f; // ^^^
-    const float MIN_SEPARATION_VELOCITY = 0.01f;
-    
-    delta_time = std::min(delta_time, 0.033f); // cap DT to prevent calculation issues
-    
-    for (auto& obj : objects) {
-        obj.velocity *= DAMPING;
-        
-        float speed = glm::length(obj.velocity);
-        if (speed > MAX_VELOCITY) {
-            obj.velocity = glm::normalize(obj.velocity) * MAX_VELOCITY;
-        }
+// a positive count following a command line flag, anything else is reported and rejected
+bool parseCount(const char* flag, const char* text, int& count) {
+    const char* end = text + std::strlen(text);
+    auto [parsed_end, error] = std::from_chars(text, end, count);
+    if (error != std::errc() || parsed_end != end || count <= 0) {
+        std::cerr << flag << " expects a positive count, got \"" << text << "\"" << std::endl;
+        return false;
     }
+    return true;
+}
 
-    for (auto& obj : objects) {
-        obj.position += obj.velocity * delta_time;
+// steps a few thousand independent, windowless worlds with varied seeds, restitution and
+// box sizes and prints a summary per parameter set. used for tuning content offline
+int runPhysicsSweep(int world_count) {
+    const float RESTITUTIONS[] = {0.5f, 0.75f, 0.9f, 1.0f};
+    const float BOX_SIZES[] = {10.0f, 15.0f, 20.0f};
+    const int PARAM_SETS = 4 * 3;
+    const float STEP = 1.0f / 60.0f;
+    const int STEP_COUNT = 600;
+
+    std::vector<PhysicsWorld> worlds;
+    worlds.reserve(world_count);
+    for (int i = 0; i < world_count; ++i) {
+        PhysicsParams params = defaultPhysicsParams();
+        params.restitution = RESTITUTIONS[i % PARAM_SETS / 3];
+        params.box_size = BOX_SIZES[i % 3];
+        worlds.push_back(createRandomWorld(static_cast<uint32_t>(i), CONFIG::NUM_ICOSPHERES, CONFIG::ICOSPHERE_RADIUS, params));
     }
 
-    for (auto& obj : objects) {
-        for (int i = 0; i < 3; ++i) {
-            if (obj.position[i] - obj.radius < -BOX_HALF_SIZE) {
-                obj.position[i] = -BOX_HALF_SIZE + obj.radius;
-                obj.velocity[i] *= -RESTITUTION;
-            } else if (obj.position[i] + obj.radius > BOX_HALF_SIZE) {
-                obj.position[i] = BOX_HALF_SIZE - obj.radius;
-                obj.velocity[i] *= -RESTITUTION;
-            }
+    auto start = std::chrono::steady_clock::now();
+    stepPhysicsWorlds(worlds, STEP, STEP_COUNT);
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "swept " << world_count << " worlds x " << STEP_COUNT << " steps in " << elapsed_ms << "ms\n";
+    for (int set = 0; set < PARAM_SETS; ++set) {
+        double energy = 0.0;
+        int count = 0;
+        for (int i = set; i < world_count; i += PARAM_SETS) {
+            for (const auto& body : worlds[i].objects) energy += 0.5 * glm::dot(body.velocity, body.velocity);
+            count++;
         }
+        if (count == 0) continue;
+        std::cout << "restitution " << worlds[set].params.restitution << " box " << worlds[set].params.box_size
+                  << ": mean kinetic energy " << energy / count << "\n";
     }
+    return 0;
+}
 
-    for (size_t i = 0; i < objects.size(); ++i) {
-        for (size_t j = i + 1; j < objects.size(); ++j) {
-            auto& obj1 = objects[i];
-            auto& obj2 = objects[j];
+// times the float and fixed point backends against updatePhysics on the same scene. the
+// fixed point state hash should be identical on every machine and build configuration
+int runPhysicsBenchmark() {
+    const int BODY_COUNT = 512;
+    const int STEP_COUNT = 300;
+    const float STEP = 1.0f / 60.0f;
+
+    PhysicsParams params = defaultPhysicsParams();
+    params.box_size = 40.0f;
+    PhysicsWorld world = createRandomWorld(1234u, BODY_COUNT, CONFIG::ICOSPHERE_RADIUS, params);
+
+    auto time_ms = [](auto&& step) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < STEP_COUNT; ++i) step();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / STEP_COUNT;
+    };
 
-            glm::vec3 delta = obj2.position - obj1.position;
-            float distance = glm::length(delta);
-            float combined_radii = obj1.radius + obj2.radius;
+    std::vector<SceneObject> objects = world.objects;
+    SphereBodies<float> float_bodies = loadSphereBodies<float>(world.objects);
+    SphereBodies<Fixed> fixed_bodies = loadSphereBodies<Fixed>(world.objects);
 
-            if (distance > 0 && distance < combined_radii) {
-                glm::vec3 collision_normal = delta / distance;
-                
-                float overlap = combined_radii - distance;
-                
-                float separation_distance = overlap * 0.51f;
-                obj1.position -= collision_normal * separation_distance;
-                obj2.position += collision_normal * separation_distance;
-                
-                glm::vec3 relative_velocity = obj2.velocity - obj1.velocity;
-                float vel_along_normal = glm::dot(relative_velocity, collision_normal);
-                
-                if (vel_along_normal > 0) continue;
-                
-                float impulse_magnitude = -(1.0f + RESTITUTION) * vel_along_normal / 2.0f;
-                glm::vec3 impulse = impulse_magnitude * collision_normal;
-                
-                obj1.velocity -= impulse;
-                obj2.velocity += impulse;
-                
-                float separation_speed = glm::length(obj1.velocity - obj2.velocity);
-                if (separation_speed < MIN_SEPARATION_VELOCITY) {
-                    obj1.velocity -= collision_normal * MIN_SEPARATION_VELOCITY * 0.5f;
-                    obj2.velocity += collision_normal * MIN_SEPARATION_VELOCITY * 0.5f;
-                }
-            }
-        }
-    }
+    double aos_ms = time_ms([&] { updatePhysics(objects, STEP, params); });
+    double float_ms = time_ms([&] { stepSphereBodies(float_bodies, STEP, params); });
+    double fixed_ms = time_ms([&] { stepSphereBodies(fixed_bodies, STEP, params); });
 
-    for (auto& obj : objects) {
-        float speed = glm::length(obj.velocity);
-        if (speed > MAX_VELOCITY) {
-            obj.velocity = glm::normalize(obj.velocity) * MAX_VELOCITY;
+    uint64_t hash = 1469598103934665603ull; // fnv-1a over the raw fixed point state
+    for (const auto* array : {&fixed_bodies.px, &fixed_bodies.py, &fixed_bodies.pz, &fixed_bodies.vx, &fixed_bodies.vy, &fixed_bodies.vz}) {
+        for (Fixed value : *array) {
+            hash = (hash ^ static_cast<uint32_t>(value.raw)) * 1099511628211ull;
         }
     }
 
-    for (auto& obj : objects) {
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, obj.position);
-        model = glm::scale(model, glm::vec3(obj.radius)); 
-        obj.model_matrix = model;
+    // the same scene again with a sensor over a quarter of the box. every body inside at the
+    // end must be accounted for by an enter that no exit cancelled
+    TriggerSystem triggers;
+    triggers.volumes.push_back({TRIGGER_BOX, glm::vec3(params.box_size / 4.0f), glm::vec3(params.box_size / 4.0f), 0.0f});
+    objects = world.objects;
+    uint64_t enters = 0, exits = 0;
+    double trigger_ms = 0.0;
+    for (int i = 0; i < STEP_COUNT; ++i) {
+        updatePhysics(objects, STEP, params);
+        auto start = std::chrono::steady_clock::now();
+        updateTriggers(triggers, objects);
+        trigger_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        enters += triggers.entered.size();
+        exits += triggers.exited.size();
     }
+    const bool triggers_balance = enters - exits == triggers.inside.size();
+
+    std::cout << BODY_COUNT << " bodies, " << STEP_COUNT << " steps\n"
+              << "updatePhysics (float, aos): " << aos_ms << "ms/step\n"
+              << "stepSphereBodies<float>:    " << float_ms << "ms/step\n"
+              << "stepSphereBodies<Fixed>:    " << fixed_ms << "ms/step\n"
+              << "updateTriggers:             " << trigger_ms / STEP_COUNT << "ms/step, " << enters << " enters, "
+              << exits << " exits, " << triggers.inside.size() << " inside" << (triggers_balance ? "\n" : " (unbalanced)\n")
+              << "fixed point state hash: " << std::hex << hash << std::dec << "\n";
+    return triggers_balance ? 0 : 1;
 }
 
+int main(int argc, char** argv) {
+    // headless renders a fixed number of frames offscreen with no window or input
+    int headless_frames = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--sweep") {
+            int world_count = 4096;
+            if (i + 1 < argc && !parseCount("--sweep", argv[i + 1], world_count)) return 1;
+            return runPhysicsSweep(world_count);
+        }
+        if (std::string(argv[i]) == "--bench-physics") {
+            return runPhysicsBenchmark();
+        }
+        if (std::string(argv[i]) == "--headless") {
+            headless_frames = CONFIG::HEADLESS_FRAMES;
+            // a zero or negative count would quietly fall through to opening a window
+            if (i + 1 < argc && !parseCount("--headless", argv[++i], headless_frames)) return 1;
+        }
+    }
 
-int main() {
     UserState* user = new UserState {
         nullptr, 90.0f, true, true, CONFIG::MIN_FRAMES_PER_CURSOR_TOGGLE,
         -90.0f, 0.0f, 0.0f, 0.0f, {0, 0, 25}, {0, 0, -1}, {0, 1, 0},
         {0, 0, 25}, 0.0f
     };
 
-    GLFWwindow* window = createWindow(user);
-    if (!window) return -1;
+    GLFWwindow* window = nullptr;
+    HeadlessContext* headless = nullptr;
+    GLFWvidmode headless_mode = {CONFIG::HEADLESS_WIDTH, CONFIG::HEADLESS_HEIGHT, 8, 8, 8, 60};
+    if (headless_frames > 0) {
+        headless = createHeadlessContext(CONFIG::HEADLESS_WIDTH, CONFIG::HEADLESS_HEIGHT);
+        if (!headless) return -1;
+        user->mode = &headless_mode;
+    } else {
+        window = createWindow(user);
+        if (!window) return -1;
+    }
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_DEBUG_OUTPUT);
     glDebugMessageCallback(messageCallback, 0);
 
-    unsigned int shader_program = createShaderProgram(CONFIG::SHADER_PATH);
-    glUseProgram(shader_program);
-    setInt(shader_program, "primary_texture", 0);
-
-    setVec3(shader_program, "light_position", glm::vec3(0.0f, 20.0f, 0.0f));
-    setVec3(shader_program, "light_color", glm::vec3(1.0f, 1.0f, 1.0f));
-    setFloat(shader_program, "constant_attenuation", 1.0f);
-    setFloat(shader_program, "linear_attenuation", 0.01f);
-    setFloat(shader_program, "quadratic_attenuation", 0.001f);
-
-    setVec3(shader_program, "material.ambient", glm::vec3(0.3f, 0.3f, 0.3f));
-    setVec3(shader_program, "material.diffuse", glm::vec3(0.8f, 0.8f, 0.8f));
-    setVec3(shader_program, "material.specular", glm::vec3(1.0f, 1.0f, 1.0f));
-    setFloat(shader_program, "material.shininess", 32.0f);
-
-    setBool(shader_program, "render_wireframe", false);
-
-    unsigned int blueprint_texture = loadTexture(CONFIG::BLUEPRINT_TEXTURE_PATH, false);
-    unsigned int white_texture = loadTexture(CONFIG::WHITE_TEXTURE_PATH, false);
+    // every variant is submitted now and collected after the assets load, so the driver
+    // compiles them in the background when it supports parallel compiles
+    PendingShaderProgram* pending_variants[SHADER_VARIANT_COUNT] = {};
+    for (int variant = 0; variant < SHADER_VARIANT_COUNT; ++variant) {
+        pending_variants[variant] = beginShaderProgram(CONFIG::SHADER_PATH, SHADER_VARIANT_DEFINES[variant]);
+    }
+    PendingShaderProgram* pending_depth = CONFIG::DEPTH_PREPASS ? beginShaderProgram(CONFIG::DEPTH_SHADER_PATH, {}) : nullptr;
+    ShaderProgram* shader_variants[SHADER_VARIANT_COUNT] = {};
+    ShaderProgram* depth_program = nullptr;
+
+    // light state only changes here, the camera half is rewritten every frame
+    FrameUniforms frame_uniforms;
+    frame_uniforms.light_position = glm::vec4(0.0f, 20.0f, 0.0f, 1.0f);
+    frame_uniforms.light_color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+    frame_uniforms.attenuation = glm::vec4(1.0f, 0.01f, 0.001f, 0.0f);
+    // every icosphere and the box can be drawn in one frame, the ring grows if lights need more
+    RingBuffer* stream = createRingBuffer(CONFIG::STREAM_BUFFER_FRAME_SIZE + (CONFIG::NUM_ICOSPHERES + 1) * sizeof(InstanceData));
+
+    MaterialUniforms default_material;
+    default_material.ambient = glm::vec4(0.3f, 0.3f, 0.3f, 0.0f);
+    default_material.diffuse = glm::vec4(0.8f, 0.8f, 0.8f, 0.0f);
+    default_material.specular = glm::vec4(1.0f, 1.0f, 1.0f, 32.0f);
+    MaterialLibrary* materials = createMaterialLibrary({ default_material });
+    const unsigned int DEFAULT_MATERIAL = 0;
+
+    // decoded on worker threads and streamed in over the first frames, white until then
+    TextureManager* textures = createTextureManager();
+    TextureLoader* texture_loader = createTextureLoader(CONFIG::TEXTURE_DECODE_THREADS);
+    unsigned int blueprint_texture = requestTexture(textures, texture_loader, CONFIG::BLUEPRINT_TEXTURE_PATH, false);
+    unsigned int white_texture = requestTexture(textures, texture_loader, CONFIG::WHITE_TEXTURE_PATH, false);
     
-    Mesh* box_mesh = generateMesh(CONFIG::CUBE_VERTICES);
+    GeometryPool* geometry = createGeometryPool(CONFIG::GEOMETRY_POOL_VERTICES, CONFIG::GEOMETRY_POOL_INDICES);
+    attachInstanceStream(geometry, stream);
+    GpuProfiler* gpu_profiler = CONFIG::GPU_PROFILER ? createGpuProfiler() : nullptr;
+    OcclusionBuffer* occlusion = createOcclusionBuffer(CONFIG::OCCLUSION_BUFFER_WIDTH, CONFIG::OCCLUSION_BUFFER_HEIGHT, CONFIG::OCCLUSION_THREADS);
+
+    Mesh* box_mesh = generateMesh(geometry, CONFIG::CUBE_VERTICES, "box");
+    Mesh* icosphere_mesh = nullptr;
+
+    // every return from here on tears down whatever exists so far, so a failed startup still
+    // joins the worker threads and releases the gl objects before the context goes
+    auto shutdown = [&](int exit_code) {
+        for (PendingShaderProgram* pending : pending_variants) if (pending) cancelShaderProgram(pending);
+        if (pending_depth) cancelShaderProgram(pending_depth);
+        for (ShaderProgram* variant : shader_variants) delete variant;
+        delete depth_program;
+
+        if (box_mesh) freeMesh(geometry, box_mesh);
+        if (icosphere_mesh) freeMesh(geometry, icosphere_mesh);
+        destroyGeometryPool(geometry);
+        destroyRingBuffer(stream);
+        destroyOcclusionBuffer(occlusion);
+        if (gpu_profiler) destroyGpuProfiler(gpu_profiler);
+        destroyMaterialLibrary(materials);
+        destroyTextureLoader(texture_loader);
+        destroyTextureManager(textures);
+
+        delete user;
+
+        if (headless) {
+            destroyHeadlessContext(headless);
+        } else {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
+        return exit_code;
+    };
+    if (!box_mesh) return shutdown(-1);
     
     std::vector<float> icosphere_vertices = readFBXFile(CONFIG::FBX_ICOSPHERE_PATH);
     if (icosphere_vertices.empty()) {
         std::cerr << "Failed to load icosphere model, cannot continue." << std::endl;
-        glfwTerminate();
-        return -1;
+        return shutdown(-1);
     }
-    Mesh* icosphere_mesh = generateMesh(icosphere_vertices);
+    icosphere_mesh = generateMesh(geometry, icosphere_vertices, CONFIG::FBX_ICOSPHERE_PATH);
+    if (!icosphere_mesh) return shutdown(-1);
+    OccluderMesh icosphere_occluder = generateOccluderMesh(icosphere_vertices);
     
     std::vector<SceneObject> icospheres;
     for(int i = 0; i < CONFIG::NUM_ICOSPHERES; ++i) {
         icospheres.push_back(createIcosphere(icosphere_mesh, CONFIG::ICOSPHERE_RADIUS));
     }
 
-    float last_frame = 0.0f;
+    int variants_ready_early = 0;
+    for (int variant = 0; variant < SHADER_VARIANT_COUNT; ++variant) {
+        if (!pending_variants[variant]) return shutdown(-1);
+        variants_ready_early += isShaderProgramReady(pending_variants[variant]);
+        // create frees the pending program whether or not it links
+        shader_variants[variant] = ShaderProgram::create(pending_variants[variant]);
+        pending_variants[variant] = nullptr;
+        if (!shader_variants[variant]) return shutdown(-1);
+        shader_variants[variant]->set(UNIFORM_PRIMARY_TEXTURE, 0);
+        shader_variants[variant]->set(UNIFORM_RENDER_WIREFRAME, false);
+    }
+    // without it the lit pass just writes depth itself
+    if (pending_depth) depth_program = ShaderProgram::create(pending_depth);
+    pending_depth = nullptr;
+    if (CONFIG::DEPTH_PREPASS && !depth_program) std::cerr << "depth pre-pass disabled, its program failed to build" << std::endl;
+    const ShaderCacheStats& shader_cache = getShaderCacheStats();
+    std::cout << "shader startup: " << (shader_cache.misses ? "cold" : "warm") << ", "
+              << shader_cache.hits << " cached (" << shader_cache.warm_ms << "ms), "
+              << shader_cache.misses << " compiled (" << shader_cache.cold_ms << "ms)";
+    if (hasParallelShaderCompile()) std::cout << ", " << variants_ready_early << "/" << static_cast<int>(SHADER_VARIANT_COUNT) << " finished while loading assets";
+    std::cout << "\n";
+
+    // small coloured lights circling around random points in the box. orbits hold each
+    // light's centre with its phase in w
+    std::vector<PointLight> point_lights(CONFIG::NUM_POINT_LIGHTS);
+    std::vector<glm::vec4> light_orbits(CONFIG::NUM_POINT_LIGHTS);
+    const float light_range = CONFIG::BOX_SIZE / 2.0f;
+    for (int i = 0; i < CONFIG::NUM_POINT_LIGHTS; ++i) {
+        light_orbits[i] = glm::vec4(randomFloat(-light_range, light_range), randomFloat(-light_range, light_range),
+                                    randomFloat(-light_range, light_range), randomFloat(0.0f, 6.2831853f));
+        point_lights[i].color = glm::vec4(randomFloat(0.2f, 1.0f), randomFloat(0.2f, 1.0f), randomFloat(0.2f, 1.0f), 0.0f);
+    }
+    LightClusters light_clusters;
+
+    const glm::mat4 box_model = glm::scale(glm::mat4(1.0f), glm::vec3(CONFIG::BOX_SIZE));
+    RenderQueue render_queue;
+    // ids only order the queue, they just need to differ per mesh
+    const unsigned int BOX_MESH_ID = 0;
+    const unsigned int ICOSPHERE_MESH_ID = 1;
+    CullSpheres icosphere_bounds;
+    std::vector<uint32_t> visible_icospheres;
+    std::vector<uint8_t> icosphere_lods;
+    std::vector<uint32_t> icosphere_lod_buckets[MAX_MESH_LODS];
+    std::vector<uint32_t> occluder_candidates;
+    std::vector<Occluder> occluders;
+
+    PhysicsLodScheduler physics_lod;
+    // a sphere sensor in the middle of the box and a box sensor in one corner. their traffic
+    // is totalled here and reported with the physics stats and at the end of headless runs
+    TriggerSystem triggers;
+    triggers.volumes.push_back({TRIGGER_SPHERE, glm::vec3(0.0f), glm::vec3(0.0f), CONFIG::BOX_SIZE / 6.0f});
+    triggers.volumes.push_back({TRIGGER_BOX, glm::vec3(CONFIG::BOX_SIZE / 4.0f), glm::vec3(CONFIG::BOX_SIZE / 8.0f), 0.0f});
+    uint64_t trigger_enters = 0;
+    uint64_t trigger_exits = 0;
+    const auto start_time = std::chrono::steady_clock::now();
+    auto last_frame = start_time;
+    int frame_count = 0;
+    float light_time = 0.0f; // summed frame deltas, so headless runs animate the same way every time
     
-    while (!glfwWindowShouldClose(window)) {
-        float current_frame = (float)glfwGetTime();
-        user->delta_time = current_frame - last_frame;
+    while (headless ? frame_count < headless_frames : !glfwWindowShouldClose(window)) {
+        auto current_frame = std::chrono::steady_clock::now();
+        float frame_seconds = std::chrono::duration<float>(current_frame - last_frame).count();
         last_frame = current_frame;
-        if (CONFIG::OUT_FPS) {
-            std::cout << "FPS: " << 1.0f / user->delta_time << "\r" << std::flush;
+        ++frame_count;
+
+        // headless runs step a fixed 60hz so every regression run simulates the same scene
+        user->delta_time = headless ? 1.0f / 60.0f : frame_seconds;
+        if (CONFIG::OUT_FPS && !headless) {
+            std::cout << "FPS: " << 1.0f / user->delta_time << " | cpu " << user->delta_time * 1000.0f << "ms";
+            if (gpu_profiler) std::cout << " | gpu " << formatGpuTimings(gpu_profiler);
+            std::cout << "\r" << std::flush;
         }
         
-        processInput(window, user);
+        if (window) processInput(window, user);
 
-        updatePhysics(icospheres, user->delta_time);
+        glm::mat4 projection = glm::perspective(glm::radians(user->fov), (float)user->mode->width / (float)user->mode->height, CONFIG::NEAR_PLANE, CONFIG::FAR_PLANE);
+        glm::mat4 view = glm::lookAt(user->camera_position, user->camera_position + user->camera_front, user->camera_up);
+
+        if (CONFIG::PHYSICS_LOD) updatePhysicsLod(icospheres, physics_lod, user->delta_time, user->camera_position, projection * view);
+        else updatePhysics(icospheres, user->delta_time);
+        updateTriggers(triggers, icospheres);
+        trigger_enters += triggers.entered.size();
+        trigger_exits += triggers.exited.size();
+        if (CONFIG::PHYSICS_STATS) {
+            std::cout << "triggers: " << triggers.inside_offsets[1] << " in the sphere, "
+                      << triggers.inside_offsets[2] - triggers.inside_offsets[1] << " in the box"
+                      << " | " << triggers.entered.size() << " entered, " << triggers.exited.size() << " exited\n";
+        }
+
+        if (gpu_profiler) {
+            beginGpuFrame(gpu_profiler);
+            beginGpuPass(gpu_profiler, "frame");
+        }
 
         glClearColor(CONFIG::WINDOW_COLOR.r, CONFIG::WINDOW_COLOR.g, CONFIG::WINDOW_COLOR.b, CONFIG::WINDOW_COLOR.a);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glUseProgram(shader_program);
+        frame_uniforms.projection = projection;
+        frame_uniforms.view = view;
+        frame_uniforms.view_position = glm::vec4(user->camera_position, 1.0f);
+        frame_uniforms.cluster_scale = clusterScale(CONFIG::NEAR_PLANE, CONFIG::FAR_PLANE, user->mode->width, user->mode->height);
+        if (beginRingFrame(stream)) attachInstanceStream(geometry, stream);
+        updateFrameUniforms(stream, frame_uniforms);
+
+        light_time += user->delta_time;
+        for (int i = 0; i < CONFIG::NUM_POINT_LIGHTS; ++i) {
+            const float phase = light_orbits[i].w + light_time;
+            glm::vec3 offset(std::cos(phase), std::sin(phase * 0.7f), std::sin(phase));
+            point_lights[i].position_radius = glm::vec4(glm::vec3(light_orbits[i]) + offset, CONFIG::POINT_LIGHT_RADIUS);
+        }
+        buildLightClusters(light_clusters, point_lights, projection, view, CONFIG::NEAR_PLANE, CONFIG::FAR_PLANE);
+        uploadLightClusters(stream, light_clusters, point_lights);
+
+        if (texturesPending(texture_loader)) {
+            updateTextureLoader(texture_loader, textures);
+            if (!texturesPending(texture_loader)) {
+                float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+                std::cout << "textures streamed in by frame " << frame_count << " (" << ms << "ms after the first frame)\n";
+            }
+        }
 
-        glm::mat4 projection = glm::perspective(glm::radians(user->fov), (float)user->mode->width / (float)user->mode->height, 0.1f, 200.0f);
-        glm::mat4 view = glm::lookAt(user->camera_position, user->camera_position + user->camera_front, user->camera_up);
-        setMat4(shader_program, "projection", projection);
-        setMat4(shader_program, "view", view);
-        setVec3(shader_program, "view_position", user->camera_position);
-        
-        glBindVertexArray(box_mesh->vao);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, blueprint_texture);
+        clearRenderQueue(render_queue);
+
+        // the box and the icospheres are only ever scaled evenly, so they skip the normal matrices
+        RenderItem box_item;
+        box_item.pass = RENDER_PASS_WIREFRAME;
+        box_item.program = SHADER_VARIANT_UNIFORM_SCALE;
+        box_item.texture = textureArrayName(textures, blueprint_texture);
+        box_item.material = DEFAULT_MATERIAL;
+        box_item.command = makeDrawCommand(box_mesh, uploadInstances(stream, &box_model, 1, true, textureSlot(textures, blueprint_texture).layer));
+        pushRenderItem(render_queue, box_item, BOX_MESH_ID, 0.0f);
+
+        // culling sorts the icospheres into one bucket per lod, each bucket is one instanced draw
+        if (CONFIG::FRUSTUM_CULLING) {
+            gatherCullSpheres(icospheres, icosphere_bounds);
+            Frustum frustum = extractFrustum(projection * view);
+            if (CONFIG::MESH_LOD) {
+                LodView lod_view = makeLodView(user->camera_position, user->fov, user->mode->height);
+                cullSpheresLod(frustum, icosphere_bounds, lod_view, icosphere_mesh->lod_count,
+                               icosphere_lods, visible_icospheres, icosphere_lod_buckets);
+            } else {
+                cullSpheres(frustum, icosphere_bounds, icosphere_lod_buckets[0]);
+            }
 
-        glm::mat4 box_model = glm::mat4(1.0f);
-        box_model = glm::scale(box_model, glm::vec3(CONFIG::BOX_SIZE));
-        setMat4(shader_program, "model", box_model);
+            // the nearest survivors hide the rest. an icosphere never hides itself, its
+            // bounding sphere reaches in front of its own surface
+            if (CONFIG::OCCLUSION_CULLING) {
+                occluder_candidates.clear();
+                for (const auto& bucket : icosphere_lod_buckets) occluder_candidates.insert(occluder_candidates.end(), bucket.begin(), bucket.end());
+                auto distance_to_camera = [&](uint32_t i) { return glm::length2(icospheres[i].position - user->camera_position); };
+                if (occluder_candidates.size() > static_cast<size_t>(CONFIG::OCCLUSION_MAX_OCCLUDERS)) {
+                    std::nth_element(occluder_candidates.begin(), occluder_candidates.begin() + CONFIG::OCCLUSION_MAX_OCCLUDERS, occluder_candidates.end(),
+                                     [&](uint32_t a, uint32_t b) { return distance_to_camera(a) < distance_to_camera(b); });
+                    occluder_candidates.resize(CONFIG::OCCLUSION_MAX_OCCLUDERS);
+                }
+                occluders.clear();
+                for (uint32_t i : occluder_candidates) occluders.push_back({&icosphere_occluder, icospheres[i].model_matrix});
 
-        setBool(shader_program, "render_wireframe", true);
+                renderOccluders(*occlusion, occluders, projection, view);
+                for (auto& bucket : icosphere_lod_buckets) cullOccludedSpheres(*occlusion, icosphere_bounds, bucket);
+            }
+        } else {
+            icosphere_lod_buckets[0].resize(icospheres.size());
+            for (size_t i = 0; i < icospheres.size(); ++i) icosphere_lod_buckets[0][i] = static_cast<uint32_t>(i);
+        }
 
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        glDrawArrays(GL_TRIANGLES, 0, box_mesh->vertex_count);
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        RenderItem icosphere_item;
+        icosphere_item.pass = RENDER_PASS_OPAQUE;
+        icosphere_item.program = SHADER_VARIANT_UNIFORM_SCALE;
+        icosphere_item.texture = textureArrayName(textures, white_texture);
+        icosphere_item.material = DEFAULT_MATERIAL;
+        for (unsigned int lod = 0; lod < icosphere_mesh->lod_count; ++lod) {
+            if (icosphere_lod_buckets[lod].empty()) continue;
+            InstanceRange instances = uploadInstances(stream, icospheres, icosphere_lod_buckets[lod], true, textureSlot(textures, white_texture).layer);
+            icosphere_item.command = makeDrawCommand(icosphere_mesh, instances, lod);
+            // an instanced batch has no single depth, so it only sorts by state
+            pushRenderItem(render_queue, icosphere_item, ICOSPHERE_MESH_ID, 0.0f);
+        }
 
-        setBool(shader_program, "render_wireframe", false);
+        sortRenderQueue(render_queue);
+        if (depth_program) {
+            glBindVertexArray(geometry->depth_vao);
+            submitDepthPrepass(render_queue, depth_program, stream, gpu_profiler);
+        }
+        glBindVertexArray(geometry->vao);
+        if (gpu_profiler) beginFragmentCount(gpu_profiler);
+        submitRenderQueue(render_queue, shader_variants, materials, stream, gpu_profiler, depth_program != nullptr);
+        if (gpu_profiler) endFragmentCount(gpu_profiler);
+        if (CONFIG::RENDER_STATS) {
+            const RenderQueueStats& stats = render_queue.stats;
+            std::cout << "render items: " << stats.items
+                      << " | programs " << stats.unsorted.programs << " -> " << stats.sorted.programs
+                      << " | textures " << stats.unsorted.textures << " -> " << stats.sorted.textures
+                      << " | materials " << stats.unsorted.materials << " -> " << stats.sorted.materials
+                      << " | draws " << stats.unsorted.draw_calls << " -> " << stats.sorted.draw_calls << "\n";
+            std::cout << "lights: " << light_clusters.stats.lights << " in " << CLUSTER_COUNT << " clusters"
+                      << " | " << light_clusters.stats.references << " references, at most "
+                      << light_clusters.stats.max_per_cluster << " per cluster\n";
+            if (CONFIG::OCCLUSION_CULLING) {
+                std::cout << "occlusion: " << occlusion->stats.occluders << " occluders, " << occlusion->stats.triangles << " triangles in "
+                          << occlusion->stats.raster_ms << "ms | " << occlusion->stats.occluded << " of " << occlusion->stats.tested << " hidden\n";
+            }
+            if (gpu_profiler && gpu_profiler->fragment_invocations) {
+                // shaded fragments per pixel, 1 is no overdraw at full coverage
+                float pixels = static_cast<float>(user->mode->width) * static_cast<float>(user->mode->height);
+                std::cout << "fragments shaded: " << gpu_profiler->fragment_invocations << " ("
+                          << static_cast<float>(gpu_profiler->fragment_invocations) / pixels << " per pixel)\n";
+            }
+        }
 
-        glBindVertexArray(icosphere_mesh->vao);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, white_texture);
+        if (gpu_profiler) endGpuPass(gpu_profiler);
+        endRingFrame(stream);
 
-        for(const auto& sphere : icospheres) {
-            setMat4(shader_program, "model", sphere.model_matrix);
-            glDrawArrays(GL_TRIANGLES, 0, icosphere_mesh->vertex_count);
+        if (window) {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
         }
-
-        glfwSwapBuffers(window);
-        glfwPollEvents();
     }
 
-    glDeleteVertexArrays(1, &box_mesh->vao);
-    glDeleteBuffers(1, &box_mesh->vbo);
-    delete box_mesh;
-
-    glDeleteVertexArrays(1, &icosphere_mesh->vao);
-    glDeleteBuffers(1, &icosphere_mesh->vbo);
-    delete icosphere_mesh;
-    
-    delete user;
+    if (headless) {
+        glFinish();
+        float total_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << "headless: " << frame_count << " frames in " << total_ms << "ms ("
+                  << total_ms / static_cast<float>(frame_count) << "ms per frame)" << std::endl;
+        if (gpu_profiler) std::cout << "headless gpu: " << formatGpuTimings(gpu_profiler) << std::endl;
+        std::cout << "headless triggers: " << trigger_enters << " enters, " << trigger_exits << " exits, "
+                  << triggers.inside.size() << " bodies inside at the end" << std::endl;
+    }
 
-    glDeleteProgram(shader_program);
-    glfwDestroyWindow(window);
-    glfwTerminate();
-    return 0;
+    return shutdown(0);
 }
 
 
@@ -295,148 +552,6 @@ void GLAPIENTRY messageCallback([[maybe_unused]] GLenum source, GLenum type, [[m
 
 
 
-// SHADING
-
-GLenum getShaderType(const std::string& file_extension) {
-    if (file_extension == ".vert") return GL_VERTEX_SHADER;
-    if (file_extension == ".frag") return GL_FRAGMENT_SHADER;
-    std::cerr << "invalid shader extension type: " << file_extension << "\n";
-    return 0;
-}
-
-std::string stringifyShaderSource(const std::string& file_path) {
-    std::ifstream shader_file(file_path);
-    if (!shader_file.is_open()) {
-        std::cerr << "failed to open shader file at: " + file_path << "\n";
-        return "";
-    }
-    std::stringstream buffer;
-    buffer << shader_file.rdbuf();
-    return buffer.str();
-};
-
-unsigned int compileShader(const std::string& shader_source, GLenum shader_type) {
-    unsigned int shader = glCreateShader(shader_type);
-    const char *shader_c_str = shader_source.c_str();
-    glShaderSource(shader, 1, &shader_c_str, nullptr);
-    glCompileShader(shader);
-
-    int success;
-    char infoLog[512];
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
-        std::cerr << "shader compilation failed:\n" << infoLog << "\n";
-        glDeleteShader(shader);
-        return 0;
-    }
-    return shader;
-}
-
-unsigned int createShaderProgram(const std::string& shader_folder_path) {
-    std::vector<unsigned int> shaders;
-    unsigned int shader_program = glCreateProgram();
-
-    for (const auto& entry : std::filesystem::directory_iterator(shader_folder_path)) {
-        if (!entry.is_regular_file()) continue;
-        
-        std::string file_path = entry.path().string();
-        std::string extension = entry.path().extension().string();
-        
-        GLenum shader_type = getShaderType(extension);
-        if(shader_type == 0) continue;
-
-        std::string shader_source = stringifyShaderSource(file_path);
-        if (shader_source.empty()) {
-            std::cerr << "empty shader source for: " << file_path << "\n";
-            continue;
-        }
-        
-        std::cout << "currently compiling shader: " << file_path << std::endl; // Add this line
-        unsigned int shader = compileShader(shader_source, shader_type);
-        if (!shader) {
-            std::cerr << "shader failed to load: " << file_path << "\n";
-            continue;
-        }
-        shaders.push_back(shader);
-    }
-    
-    if (shaders.empty()) {
-        std::cerr << "no shaders were successfully compiled!" << std::endl;
-        return 0;
-    }
-    
-    for (unsigned int shader : shaders) {
-        glAttachShader(shader_program, shader);
-        glDeleteShader(shader);
-    }
-
-    glLinkProgram(shader_program);
-
-    int success;
-    char infoLog[512];
-    glGetProgramiv(shader_program, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(shader_program, 512, nullptr, infoLog);
-        std::cerr << "shader program linking failed:\n" << infoLog << "\n";
-        return 0;
-    }
-    
-    std::cout << "shader program linked successfully!" << std::endl;
-    return shader_program;
-}
-
-void setInt(const unsigned int shader_program, const std::string& name, const int value) {
-    glUniform1i(glGetUniformLocation(shader_program, name.c_str()), value);
-}
-
-void setBool(unsigned int shader_program, const std::string& name, bool value) {
-    glUniform1i(glGetUniformLocation(shader_program, name.c_str()), static_cast<int>(value));
-}
-
-void setFloat(const unsigned int shader_program, const std::string& name, const float value) {
-    glUniform1f(glGetUniformLocation(shader_program, name.c_str()), value);
-}
-
-void setMat4(const unsigned int shader_program, const std::string& name, const glm::mat4& value) {
-    glUniformMatrix4fv(glGetUniformLocation(shader_program, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
-}
-
-void setVec3(const unsigned int shader_program, const std::string& name, const glm::vec3& value) {
-    glUniform3fv(glGetUniformLocation(shader_program, name.c_str()), 1, glm::value_ptr(value));
-}
-
-// TEXTURING
-
-unsigned int loadTexture(const std::filesystem::path& texture_path, bool upside_down) {
-    unsigned int texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    int width, height, channels;
-    stbi_set_flip_vertically_on_load(upside_down);
-    unsigned char *data = stbi_load(texture_path.string().c_str(), &width, &height, &channels, 0);
-    
-    if (data) {
-        GLenum format = GL_RGB;
-        if (channels == 1) format = GL_RED;
-        else if (channels == 3) format = GL_RGB;
-        else if (channels == 4) format = GL_RGBA;
-        
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cerr << "failed to load texture at: " << texture_path << " reason: " << stbi_failure_reason() << "\n";
-    }
-    stbi_image_free(data);
-    return texture;
-}
-
 // MESHES
 
 std::vector<float> readFBXFile(const std::string& file_path) {
@@ -483,30 +598,40 @@ std::vector<float> readFBXFile(const std::string& file_path) {
     return mesh_data;
 }
 
-Mesh* generateMesh(const std::vector<float>& vertices) {
+// vertices come in as one per triangle corner (CUBE_VERTICES, readFBXFile) and are welded
+// into an indexed mesh before upload
+Mesh* generateMesh(GeometryPool* pool, const std::vector<float>& vertices, const std::string& name) {
     if (vertices.empty()) {
         std::cerr << "attempted to generate a mesh with no vertex data??" << std::endl;
         return nullptr;
     }
-    Mesh* new_mesh = new Mesh();
-    new_mesh->vertex_count = vertices.size() / CONFIG::VERTEX_LENGTH;
 
-    glGenVertexArrays(1, &new_mesh->vao);
-    glBindVertexArray(new_mesh->vao);
+    std::vector<float> unique_vertices;
+    std::vector<unsigned int> indices;
+    weldVertices(vertices, unique_vertices, indices);
+
+    size_t corner_count = vertices.size() / CONFIG::VERTEX_LENGTH;
+    size_t vertex_count = unique_vertices.size() / CONFIG::VERTEX_LENGTH;
+    std::cout << "mesh " << name << ": " << corner_count << " corners -> " << vertex_count << " vertices ("
+              << static_cast<float>(corner_count) / static_cast<float>(vertex_count) << "x fewer)" << std::endl;
 
-    glGenBuffers(1, &new_mesh->vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, new_mesh->vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    int lod_levels = CONFIG::MESH_LOD ? CONFIG::MESH_LOD_LEVELS : 1;
+    std::vector<std::vector<unsigned int>> lods = buildLodChain(unique_vertices, indices, lod_levels, CONFIG::MESH_LOD_BASE_GRID);
+    std::cout << "mesh " << name << " lod triangles:";
+    for (const auto& lod : lods) std::cout << " " << lod.size() / 3;
+    std::cout << std::endl;
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, CONFIG::VERTEX_LENGTH * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, CONFIG::VERTEX_LENGTH * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, CONFIG::VERTEX_LENGTH * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    return uploadMesh(pool, unique_vertices, lods);
+}
 
-    glBindVertexArray(0);
-    return new_mesh;
+// the coarsest lod of the mesh. decimation only keeps existing vertices, so for a convex mesh
+// like the icosphere every triangle of it lies inside the full mesh and can't hide too much
+OccluderMesh generateOccluderMesh(const std::vector<float>& vertices) {
+    std::vector<float> unique_vertices;
+    std::vector<unsigned int> indices;
+    weldVertices(vertices, unique_vertices, indices);
+    std::vector<std::vector<unsigned int>> lods = buildLodChain(unique_vertices, indices, CONFIG::MESH_LOD_LEVELS, CONFIG::MESH_LOD_BASE_GRID);
+    return makeOccluderMesh(unique_vertices, lods.back());
 }
 
 // WINDOWING AND INPUT
@@ -560,6 +685,7 @@ GLFWwindow* createWindow(UserState* user) {
         std::cerr << "Failed to initialise GLAD" << "\n";
         return nullptr;
     }
+    loadShaderCompilerExtensions((GLADloadproc)glfwGetProcAddress);
 
     glViewport(0, 0, user->mode->width, user->mode->height);
     user->last_x = user->mode->width / 2.0f;
@@ -0,0 +1,339 @@
+#include "../include/occlusion.hpp"
+#include "../include/config.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+namespace {
+    // hands out the current pass's jobs one at a time until they run out
+    void runJobs(OcclusionBuffer& buffer, unsigned int worker) {
+        for (size_t index = buffer.next_job++; index < buffer.job_count; index = buffer.next_job++) buffer.job(worker, index);
+    }
+
+    void occlusionWorker(OcclusionBuffer* buffer, unsigned int worker) {
+        unsigned int seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(buffer->mutex);
+                buffer->wake.wait(lock, [&]() { return buffer->stopping || buffer->pass != seen; });
+                if (buffer->stopping) return;
+                seen = buffer->pass;
+            }
+            runJobs(*buffer, worker);
+            std::lock_guard<std::mutex> lock(buffer->mutex);
+            if (--buffer->busy == 0) buffer->done.notify_one();
+        }
+    }
+
+    // runs job_count jobs on every worker and the calling thread, returns once all are done
+    void runPass(OcclusionBuffer& buffer, size_t job_count, std::function<void(unsigned int, size_t)> job) {
+        buffer.job = std::move(job);
+        buffer.job_count = job_count;
+        buffer.next_job = 0;
+        {
+            std::lock_guard<std::mutex> lock(buffer.mutex);
+            buffer.busy = static_cast<unsigned int>(buffer.workers.size());
+            ++buffer.pass;
+        }
+        buffer.wake.notify_all();
+        runJobs(buffer, 0);
+
+        std::unique_lock<std::mutex> lock(buffer.mutex);
+        buffer.done.wait(lock, [&]() { return buffer.busy == 0; });
+    }
+
+    void rejectTriangle(OcclusionTriangle& triangle) {
+        triangle.min_x = triangle.min_y = 0;
+        triangle.max_x = triangle.max_y = -1;
+    }
+
+    // first and last pixel whose centre lies in [low, high], clamped to [0, size)
+    void pixelRange(float low, float high, int size, int& first, int& last) {
+        low = std::clamp(low, -1.0f, static_cast<float>(size) + 1.0f);
+        high = std::clamp(high, -1.0f, static_cast<float>(size) + 1.0f);
+        first = std::max(static_cast<int>(std::ceil(low - 0.5f)), 0);
+        last = std::min(static_cast<int>(std::floor(high - 0.5f)), size - 1);
+    }
+
+    // a vertex in pixels, depth is 1 / w. behind marks vertices past the near plane
+    struct ScreenVertex {
+        float x, y, depth;
+        bool behind;
+    };
+
+    // done once per vertex rather than per triangle corner, a vertex is shared by about six triangles
+    void projectVertices(const OccluderMesh& mesh, const glm::mat4& transform, int width, int height, std::vector<ScreenVertex>& out) {
+        out.resize(mesh.positions.size());
+        for (size_t v = 0; v < mesh.positions.size(); ++v) {
+            const glm::vec4 clip = transform * glm::vec4(mesh.positions[v], 1.0f);
+            ScreenVertex& vertex = out[v];
+            vertex.behind = clip.z < -clip.w;
+            vertex.depth = vertex.behind ? 0.0f : 1.0f / clip.w;
+            vertex.x = (clip.x * vertex.depth * 0.5f + 0.5f) * static_cast<float>(width);
+            vertex.y = (clip.y * vertex.depth * 0.5f + 0.5f) * static_cast<float>(height);
+        }
+    }
+
+    // edges run v0->v1, v1->v2, v2->v0 and are positive inside a counter clockwise triangle
+    void setupTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2, int width, int height, OcclusionTriangle& triangle) {
+        if (v0.behind | v1.behind | v2.behind) {
+            rejectTriangle(triangle);
+            return;
+        }
+
+        const float x[3] = {v0.x, v1.x, v2.x};
+        const float y[3] = {v0.y, v1.y, v2.y};
+        const float depth[3] = {v0.depth, v1.depth, v2.depth};
+        const float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (!(area > 0.0f)) {
+            rejectTriangle(triangle);
+            return;
+        }
+
+        pixelRange(std::min({x[0], x[1], x[2]}), std::max({x[0], x[1], x[2]}), width, triangle.min_x, triangle.max_x);
+        pixelRange(std::min({y[0], y[1], y[2]}), std::max({y[0], y[1], y[2]}), height, triangle.min_y, triangle.max_y);
+        if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y) {
+            rejectTriangle(triangle);
+            return;
+        }
+
+        for (int edge = 0; edge < 3; ++edge) {
+            const int a = edge, b = (edge + 1) % 3;
+            triangle.edge_x[edge] = y[a] - y[b];
+            triangle.edge_y[edge] = x[b] - x[a];
+            triangle.edge_c[edge] = -(triangle.edge_x[edge] * x[a] + triangle.edge_y[edge] * y[a]);
+        }
+
+        // each vertex is weighted by the edge opposite it over the area
+        const float inverse_area = 1.0f / area;
+        triangle.depth_x = (depth[0] * triangle.edge_x[1] + depth[1] * triangle.edge_x[2] + depth[2] * triangle.edge_x[0]) * inverse_area;
+        triangle.depth_y = (depth[0] * triangle.edge_y[1] + depth[1] * triangle.edge_y[2] + depth[2] * triangle.edge_y[0]) * inverse_area;
+        triangle.depth_c = (depth[0] * triangle.edge_c[1] + depth[1] * triangle.edge_c[2] + depth[2] * triangle.edge_c[0]) * inverse_area;
+    }
+
+    // OCCLUSION_LANES pixels starting at x (a multiple of OCCLUSION_LANES), straight line so
+    // it vectorises. row_* are the edge and depth values at x = 0 for this row
+    void rasterizeLanes(const OcclusionTriangle& triangle, int x, const float row_edge[3], float row_depth, float* __restrict depth) {
+        for (int l = 0; l < OCCLUSION_LANES; ++l) {
+            const float px = static_cast<float>(x + l) + 0.5f;
+            const float e0 = triangle.edge_x[0] * px + row_edge[0];
+            const float e1 = triangle.edge_x[1] * px + row_edge[1];
+            const float e2 = triangle.edge_x[2] * px + row_edge[2];
+            const float d = triangle.depth_x * px + row_depth;
+            const bool closer = (e0 >= 0.0f) & (e1 >= 0.0f) & (e2 >= 0.0f) & (d > depth[l]);
+            depth[l] = closer ? d : depth[l];
+        }
+    }
+
+    void rasterizeTile(OcclusionBuffer& buffer, int tile) {
+        const int tile_x0 = (tile % buffer.tiles_x) * OCCLUSION_TILE_WIDTH;
+        const int tile_y0 = (tile / buffer.tiles_x) * OCCLUSION_TILE_HEIGHT;
+        const int tile_x1 = tile_x0 + OCCLUSION_TILE_WIDTH - 1;
+        const int tile_y1 = tile_y0 + OCCLUSION_TILE_HEIGHT - 1;
+
+        for (int y = tile_y0; y <= tile_y1; ++y) {
+            std::fill_n(&buffer.depth[y * buffer.width + tile_x0], OCCLUSION_TILE_WIDTH, 0.0f);
+        }
+
+        // the depth test keeps the nearest, so the order bins are walked in doesn't matter
+        for (const OcclusionBins& bins : buffer.bins) {
+            for (uint32_t index : bins.tiles[tile]) {
+                const OcclusionTriangle& triangle = buffer.triangles[index];
+                // tiles start on a lane boundary, so rounding down stays inside the tile
+                const int x0 = std::max(triangle.min_x, tile_x0) / OCCLUSION_LANES * OCCLUSION_LANES;
+                const int x1 = std::min(triangle.max_x, tile_x1);
+                const int y0 = std::max(triangle.min_y, tile_y0);
+                const int y1 = std::min(triangle.max_y, tile_y1);
+
+                for (int y = y0; y <= y1; ++y) {
+                    const float py = static_cast<float>(y) + 0.5f;
+                    float row_edge[3];
+                    for (int edge = 0; edge < 3; ++edge) row_edge[edge] = triangle.edge_y[edge] * py + triangle.edge_c[edge];
+                    const float row_depth = triangle.depth_y * py + triangle.depth_c;
+
+                    float* row = &buffer.depth[y * buffer.width];
+                    for (int x = x0; x <= x1; x += OCCLUSION_LANES) rasterizeLanes(triangle, x, row_edge, row_depth, row + x);
+                }
+            }
+        }
+
+        // farthest depth per block, an empty pixel makes the whole block hide nothing
+        const int hiz_width = buffer.width / OCCLUSION_HIZ_BLOCK;
+        for (int block_y = tile_y0; block_y <= tile_y1; block_y += OCCLUSION_HIZ_BLOCK) {
+            for (int block_x = tile_x0; block_x <= tile_x1; block_x += OCCLUSION_HIZ_BLOCK) {
+                float farthest = INFINITY;
+                for (int y = block_y; y < block_y + OCCLUSION_HIZ_BLOCK; ++y) {
+                    const float* row = &buffer.depth[y * buffer.width + block_x];
+                    for (int x = 0; x < OCCLUSION_HIZ_BLOCK; ++x) farthest = std::min(farthest, row[x]);
+                }
+                buffer.hiz[(block_y / OCCLUSION_HIZ_BLOCK) * hiz_width + block_x / OCCLUSION_HIZ_BLOCK] = farthest;
+            }
+        }
+    }
+
+    // screen rectangle in hiz blocks and nearest depth of OCCLUSION_LANES view space spheres.
+    // the rectangle bounds the sphere's view space box, which stays in front of the camera
+    // whenever near_depth is positive
+    void projectSphereLanes(const float* __restrict x, const float* __restrict y, const float* __restrict z, const float* __restrict radius,
+                            float scale_x, float scale_y, int width, int height,
+                            float* __restrict near_depth, float* __restrict rect) {
+        for (int l = 0; l < OCCLUSION_LANES; ++l) {
+            const float w_near = std::max(-z[l] - radius[l], 1e-6f);
+            const float w_far = -z[l] + radius[l];
+            const float x0 = x[l] - radius[l], x1 = x[l] + radius[l];
+            const float y0 = y[l] - radius[l], y1 = y[l] + radius[l];
+            // x / w is smallest at the low edge, divided by the far w when that edge is positive
+            const float ndc_x0 = scale_x * x0 / (x0 >= 0.0f ? w_far : w_near);
+            const float ndc_x1 = scale_x * x1 / (x1 >= 0.0f ? w_near : w_far);
+            const float ndc_y0 = scale_y * y0 / (y0 >= 0.0f ? w_far : w_near);
+            const float ndc_y1 = scale_y * y1 / (y1 >= 0.0f ? w_near : w_far);
+
+            near_depth[l] = (-z[l] - radius[l] > 1e-6f) ? 1.0f / w_near : INFINITY;
+            rect[l * 4 + 0] = (ndc_x0 * 0.5f + 0.5f) * static_cast<float>(width);
+            rect[l * 4 + 1] = (ndc_y0 * 0.5f + 0.5f) * static_cast<float>(height);
+            rect[l * 4 + 2] = (ndc_x1 * 0.5f + 0.5f) * static_cast<float>(width);
+            rect[l * 4 + 3] = (ndc_y1 * 0.5f + 0.5f) * static_cast<float>(height);
+        }
+    }
+
+    bool sphereOccluded(const OcclusionBuffer& buffer, float near_depth, const float rect[4]) {
+        if (near_depth == INFINITY) return false;
+        const int hiz_width = buffer.width / OCCLUSION_HIZ_BLOCK;
+        const int hiz_height = buffer.height / OCCLUSION_HIZ_BLOCK;
+        auto block = [](float pixel, int size) {
+            return std::clamp(static_cast<int>(std::floor(std::clamp(pixel, -1.0f, 1e6f) / OCCLUSION_HIZ_BLOCK)), 0, size - 1);
+        };
+        const int x0 = block(rect[0], hiz_width), x1 = block(rect[2], hiz_width);
+        const int y0 = block(rect[1], hiz_height), y1 = block(rect[3], hiz_height);
+
+        for (int y = y0; y <= y1; ++y) {
+            const float* row = &buffer.hiz[y * hiz_width];
+            for (int x = x0; x <= x1; ++x) {
+                if (near_depth >= row[x]) return false;
+            }
+        }
+        return true;
+    }
+}
+
+OcclusionBuffer* createOcclusionBuffer(int width, int height, unsigned int thread_count) {
+    OcclusionBuffer* buffer = new OcclusionBuffer();
+    buffer->tiles_x = std::max(1, (width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH);
+    buffer->tiles_y = std::max(1, (height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT);
+    buffer->width = buffer->tiles_x * OCCLUSION_TILE_WIDTH;
+    buffer->height = buffer->tiles_y * OCCLUSION_TILE_HEIGHT;
+    buffer->depth.assign(static_cast<size_t>(buffer->width) * buffer->height, 0.0f);
+    buffer->hiz.assign(static_cast<size_t>(buffer->width / OCCLUSION_HIZ_BLOCK) * (buffer->height / OCCLUSION_HIZ_BLOCK), 0.0f);
+
+    if (thread_count == 0) thread_count = std::max(1u, std::thread::hardware_concurrency());
+    buffer->bins.resize(thread_count);
+    for (OcclusionBins& bins : buffer->bins) bins.tiles.resize(static_cast<size_t>(buffer->tiles_x) * buffer->tiles_y);
+    for (unsigned int t = 1; t < thread_count; ++t) {
+        buffer->workers.emplace_back(occlusionWorker, buffer, t);
+    }
+    return buffer;
+}
+
+void destroyOcclusionBuffer(OcclusionBuffer* buffer) {
+    {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        buffer->stopping = true;
+    }
+    buffer->wake.notify_all();
+    for (std::thread& worker : buffer->workers) worker.join();
+    delete buffer;
+}
+
+OccluderMesh makeOccluderMesh(const std::vector<float>& vertices, const std::vector<unsigned int>& indices) {
+    OccluderMesh mesh;
+    mesh.positions.resize(vertices.size() / CONFIG::VERTEX_LENGTH);
+    for (size_t v = 0; v < mesh.positions.size(); ++v) {
+        const float* vertex = &vertices[v * CONFIG::VERTEX_LENGTH];
+        mesh.positions[v] = glm::vec3(vertex[0], vertex[1], vertex[2]);
+    }
+    mesh.indices.assign(indices.begin(), indices.end());
+    return mesh;
+}
+
+void renderOccluders(OcclusionBuffer& buffer, const std::vector<Occluder>& occluders,
+                     const glm::mat4& projection, const glm::mat4& view) {
+    auto start = std::chrono::steady_clock::now();
+    buffer.projection = projection;
+    buffer.view = view;
+    buffer.stats = {};
+    buffer.stats.occluders = static_cast<uint32_t>(occluders.size());
+
+    // every occluder owns a fixed run of triangles, so setup needs no locking
+    std::vector<size_t> first_triangle(occluders.size() + 1, 0);
+    for (size_t i = 0; i < occluders.size(); ++i) {
+        first_triangle[i + 1] = first_triangle[i] + occluders[i].mesh->indices.size() / 3;
+    }
+    buffer.triangles.resize(first_triangle.back());
+    for (OcclusionBins& bins : buffer.bins) {
+        for (auto& tile : bins.tiles) tile.clear();
+        bins.triangles = 0;
+    }
+
+    const glm::mat4 view_projection = projection * view;
+    runPass(buffer, occluders.size(), [&](unsigned int worker, size_t i) {
+        thread_local std::vector<ScreenVertex> vertices;
+        const OccluderMesh& mesh = *occluders[i].mesh;
+        projectVertices(mesh, view_projection * occluders[i].model, buffer.width, buffer.height, vertices);
+
+        OcclusionBins& bins = buffer.bins[worker];
+        for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+            const uint32_t index = static_cast<uint32_t>(first_triangle[i] + t / 3);
+            OcclusionTriangle& triangle = buffer.triangles[index];
+            setupTriangle(vertices[mesh.indices[t]], vertices[mesh.indices[t + 1]], vertices[mesh.indices[t + 2]],
+                          buffer.width, buffer.height, triangle);
+            if (triangle.min_x > triangle.max_x) continue;
+
+            ++bins.triangles;
+            for (int tile_y = triangle.min_y / OCCLUSION_TILE_HEIGHT; tile_y <= triangle.max_y / OCCLUSION_TILE_HEIGHT; ++tile_y) {
+                for (int tile_x = triangle.min_x / OCCLUSION_TILE_WIDTH; tile_x <= triangle.max_x / OCCLUSION_TILE_WIDTH; ++tile_x) {
+                    bins.tiles[tile_y * buffer.tiles_x + tile_x].push_back(index);
+                }
+            }
+        }
+    });
+    for (const OcclusionBins& bins : buffer.bins) buffer.stats.triangles += bins.triangles;
+
+    runPass(buffer, static_cast<size_t>(buffer.tiles_x) * buffer.tiles_y, [&](unsigned int, size_t tile) { rasterizeTile(buffer, static_cast<int>(tile)); });
+    buffer.stats.raster_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+unsigned int cullOccludedSpheres(OcclusionBuffer& buffer, const CullSpheres& spheres, std::vector<uint32_t>& visible) {
+    alignas(32) float x[OCCLUSION_LANES], y[OCCLUSION_LANES], z[OCCLUSION_LANES], radius[OCCLUSION_LANES];
+    alignas(32) float near_depth[OCCLUSION_LANES], rect[OCCLUSION_LANES * 4];
+    const float scale_x = buffer.projection[0][0];
+    const float scale_y = buffer.projection[1][1];
+
+    size_t kept = 0;
+    for (size_t base = 0; base < visible.size(); base += OCCLUSION_LANES) {
+        const size_t lane_count = std::min<size_t>(OCCLUSION_LANES, visible.size() - base);
+        for (size_t l = 0; l < OCCLUSION_LANES; ++l) {
+            // spare lanes repeat the last sphere and are ignored
+            const uint32_t i = visible[base + std::min(l, lane_count - 1)];
+            glm::vec4 center = buffer.view * glm::vec4(spheres.x[i], spheres.y[i], spheres.z[i], 1.0f);
+            x[l] = center.x;
+            y[l] = center.y;
+            z[l] = center.z;
+            radius[l] = spheres.radius[i];
+        }
+        projectSphereLanes(x, y, z, radius, scale_x, scale_y, buffer.width, buffer.height, near_depth, rect);
+
+        for (size_t l = 0; l < lane_count; ++l) {
+            const uint32_t i = visible[base + l];
+            if (sphereOccluded(buffer, near_depth[l], &rect[l * 4])) continue;
+            visible[kept++] = i;
+        }
+    }
+
+    buffer.stats.tested += static_cast<uint32_t>(visible.size());
+    buffer.stats.occluded += static_cast<uint32_t>(visible.size() - kept);
+    visible.resize(kept);
+    return static_cast<unsigned int>(kept);
+}
@@ -0,0 +1,859 @@
+#include "../include/physics.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <random>
+#include <thread>
+
+#include "../include/config.hpp"
+#include "../include/utilities.hpp"
+
+namespace {
+    PhysicsStepStats last_stats = {};
+    uint64_t step_counter = 0;
+
+    const float MAX_DELTA_TIME = 0.033f; // cap DT to prevent calculation issues
+
+    void updateModelMatrix(SceneObject& obj) {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, obj.position);
+        model = glm::scale(model, glm::vec3(obj.radius));
+        obj.model_matrix = model;
+    }
+
+    // body_delta_times, when given, replaces delta_time per body during integration (the lod path)
+    template <bool STATS>
+    void simulateStep(std::vector<SceneObject>& objects, float delta_time, const PhysicsParams& params, PhysicsStepStats& stats,
+                      const std::vector<float>* body_delta_times = nullptr) {
+        const float BOX_HALF_SIZE = params.box_size / 2.0f;
+        const float MAX_VELOCITY = params.max_velocity;
+        const float DAMPING = params.damping;
+        const float RESTITUTION = params.restitution;
+        const float MIN_SEPARATION_VELOCITY = params.min_separation_velocity;
+
+        delta_time = std::min(delta_time, MAX_DELTA_TIME);
+
+        {
+            ScopedPhaseTimer<STATS> timer(stats.integrate_ms);
+            for (size_t i = 0; i < objects.size(); ++i) {
+                auto& obj = objects[i];
+                // damping is per delta_time, a body stepping a different time gets the matching share
+                if (body_delta_times && delta_time > 0.0f) obj.velocity *= std::pow(DAMPING, (*body_delta_times)[i] / delta_time);
+                else obj.velocity *= DAMPING;
+
+                float speed = glm::length(obj.velocity);
+                if (speed > MAX_VELOCITY) {
+                    obj.velocity = glm::normalize(obj.velocity) * MAX_VELOCITY;
+                }
+            }
+
+            if (body_delta_times) {
+                for (size_t i = 0; i < objects.size(); ++i) {
+                    objects[i].position += objects[i].velocity * (*body_delta_times)[i];
+                }
+            } else {
+                for (auto& obj : objects) {
+                    obj.position += obj.velocity * delta_time;
+                }
+            }
+        }
+
+        {
+            ScopedPhaseTimer<STATS> timer(stats.walls_ms);
+            for (auto& obj : objects) {
+                for (int i = 0; i < 3; ++i) {
+                    if (obj.position[i] - obj.radius < -BOX_HALF_SIZE) {
+                        obj.position[i] = -BOX_HALF_SIZE + obj.radius;
+                        obj.velocity[i] *= -RESTITUTION;
+                    } else if (obj.position[i] + obj.radius > BOX_HALF_SIZE) {
+                        obj.position[i] = BOX_HALF_SIZE - obj.radius;
+                        obj.velocity[i] *= -RESTITUTION;
+                    }
+                }
+            }
+        }
+
+        {
+            // the solver runs inline with the pair tests (a single gauss-seidel pass), so
+            // its time is measured per contact and taken back out of the pair time below
+            ScopedPhaseTimer<STATS> timer(stats.pairs_ms);
+            if constexpr (STATS) {
+                size_t n = objects.size();
+                stats.solver_iterations = 1;
+                stats.candidate_pairs = static_cast<uint32_t>(n > 1 ? n * (n - 1) / 2 : 0);
+            }
+
+            for (size_t i = 0; i < objects.size(); ++i) {
+                for (size_t j = i + 1; j < objects.size(); ++j) {
+                    auto& obj1 = objects[i];
+                    auto& obj2 = objects[j];
+
+                    glm::vec3 delta = obj2.position - obj1.position;
+                    float distance = glm::length(delta);
+                    float combined_radii = obj1.radius + obj2.radius;
+
+                    if (distance > 0 && distance < combined_radii) {
+                        ScopedPhaseTimer<STATS> solver_timer(stats.solver_ms);
+                        glm::vec3 collision_normal = delta / distance;
+
+                        float overlap = combined_radii - distance;
+                        if constexpr (STATS) {
+                            stats.contacts++;
+                            stats.max_penetration = std::max(stats.max_penetration, overlap);
+                        }
+
+                        float separation_distance = overlap * 0.51f;
+                        obj1.position -= collision_normal * separation_distance;
+                        obj2.position += collision_normal * separation_distance;
+
+                        glm::vec3 relative_velocity = obj2.velocity - obj1.velocity;
+                        float vel_along_normal = glm::dot(relative_velocity, collision_normal);
+
+                        if (vel_along_normal > 0) continue;
+
+                        float impulse_magnitude = -(1.0f + RESTITUTION) * vel_along_normal / 2.0f;
+                        glm::vec3 impulse = impulse_magnitude * collision_normal;
+
+                        obj1.velocity -= impulse;
+                        obj2.velocity += impulse;
+
+                        float separation_speed = glm::length(obj1.velocity - obj2.velocity);
+                        if (separation_speed < MIN_SEPARATION_VELOCITY) {
+                            obj1.velocity -= collision_normal * MIN_SEPARATION_VELOCITY * 0.5f;
+                            obj2.velocity += collision_normal * MIN_SEPARATION_VELOCITY * 0.5f;
+                        }
+                    }
+                }
+            }
+        }
+
+        {
+            ScopedPhaseTimer<STATS> timer(stats.finalize_ms);
+            for (auto& obj : objects) {
+                float speed = glm::length(obj.velocity);
+                if (speed > MAX_VELOCITY) {
+                    obj.velocity = glm::normalize(obj.velocity) * MAX_VELOCITY;
+                }
+                if constexpr (STATS) {
+                    if (glm::dot(obj.velocity, obj.velocity) < CONFIG::PHYSICS_SLEEP_SPEED * CONFIG::PHYSICS_SLEEP_SPEED) stats.sleeping_bodies++;
+                }
+            }
+
+            for (auto& obj : objects) {
+                updateModelMatrix(obj);
+            }
+        }
+
+        if constexpr (STATS) {
+            stats.pairs_ms -= stats.solver_ms;
+            stats.body_count = static_cast<uint32_t>(objects.size());
+            stats.active_bodies = stats.body_count;
+        }
+    }
+
+    // phase times add up over substeps, the counts describe the state the last one left
+    void mergeSubstepStats(PhysicsStepStats& total, const PhysicsStepStats& substep) {
+        total.integrate_ms += substep.integrate_ms;
+        total.walls_ms += substep.walls_ms;
+        total.pairs_ms += substep.pairs_ms;
+        total.solver_ms += substep.solver_ms;
+        total.finalize_ms += substep.finalize_ms;
+        total.max_penetration = std::max(total.max_penetration, substep.max_penetration);
+        total.candidate_pairs = substep.candidate_pairs;
+        total.contacts = substep.contacts;
+        total.solver_iterations = substep.solver_iterations;
+        total.sleeping_bodies = substep.sleeping_bodies;
+    }
+
+    // PHYSICS LOD
+
+    uint8_t chooseTier(uint8_t current, float distance, bool visible) {
+        const float thresholds[] = {CONFIG::PHYSICS_LOD_HALF_DISTANCE, CONFIG::PHYSICS_LOD_QUARTER_DISTANCE};
+
+        // a threshold has to be passed by the hysteresis margin in the direction of travel,
+        // so bodies hovering around one don't flip tiers every rebalance
+        uint8_t tier = PHYSICS_TIER_FULL;
+        for (int i = 0; i < 2; ++i) {
+            bool currently_past = current > i;
+            float margin = thresholds[i] * CONFIG::PHYSICS_LOD_HYSTERESIS;
+            if (distance > thresholds[i] + (currently_past ? -margin : margin)) tier = static_cast<uint8_t>(i + 1);
+        }
+
+        if (!visible) tier = std::min<uint8_t>(tier + 1, PHYSICS_TIER_QUARTER);
+        return tier;
+    }
+
+    bool bodyInsideVolume(const TriggerVolume& volume, const SceneObject& body) {
+        if (volume.shape == TRIGGER_SPHERE) {
+            glm::vec3 delta = body.position - volume.center;
+            float reach = volume.radius + body.radius;
+            return glm::dot(delta, delta) < reach * reach;
+        }
+        // closest point on the box to the sphere centre
+        glm::vec3 local = body.position - volume.center;
+        glm::vec3 closest = glm::clamp(local, -volume.half_extents, volume.half_extents);
+        glm::vec3 delta = local - closest;
+        return glm::dot(delta, delta) < body.radius * body.radius;
+    }
+
+    glm::vec3 volumeHalfExtents(const TriggerVolume& volume) {
+        return volume.shape == TRIGGER_SPHERE ? glm::vec3(volume.radius) : volume.half_extents;
+    }
+
+    // conservative: could the two bodies touch once both have integrated what they owe?
+    bool mayReach(const SceneObject& a, float a_time, const SceneObject& b, float b_time) {
+        float reach = a.radius + b.radius + glm::length(a.velocity) * a_time + glm::length(b.velocity) * b_time;
+        glm::vec3 delta = b.position - a.position;
+        return glm::dot(delta, delta) < reach * reach;
+    }
+
+    // BATCHED WORLDS
+    // structure of arrays laid out [body][lane], so every inner loop runs across worlds
+    // with unit stride and no branches and the compiler can turn it into simd. every lane
+    // performs exactly the float operations simulateStep would, in the same order, so
+    // results match updatePhysics bit for bit
+
+    constexpr int LANES = PHYSICS_BATCH_LANES;
+
+    struct WorldBatch {
+        int body_count = 0;
+        int lane_count = 0;
+        PhysicsWorld* worlds[LANES] = {};
+
+        alignas(32) float half_size[LANES];
+        alignas(32) float restitution[LANES];
+        alignas(32) float damping[LANES];
+        alignas(32) float max_velocity[LANES];
+        alignas(32) float min_separation[LANES];
+
+        std::vector<float> px, py, pz, vx, vy, vz, radius;
+    };
+
+    // branch free select. plain ternaries get merged back into branches by the optimiser,
+    // which stops the lane loops from vectorising, whereas a bit blend always compiles to a vector and/or
+    inline float laneSelect(bool mask, float if_true, float if_false) {
+        uint32_t a, b;
+        std::memcpy(&a, &if_true, sizeof(float));
+        std::memcpy(&b, &if_false, sizeof(float));
+        uint32_t m = 0u - static_cast<uint32_t>(mask);
+        uint32_t bits = (a & m) | (b & ~m);
+        float result;
+        std::memcpy(&result, &bits, sizeof(float));
+        return result;
+    }
+
+    void clampVelocities(float* __restrict vx, float* __restrict vy, float* __restrict vz, const float* __restrict max_velocity) {
+        for (int l = 0; l < LANES; ++l) {
+            float x = vx[l], y = vy[l], z = vz[l];
+            float speed = std::sqrt(x * x + y * y + z * z);
+            bool over = speed > max_velocity[l];
+            float inv_speed = 1.0f / speed; // x * inv_speed * max matches glm::normalize(v) * max
+            vx[l] = laneSelect(over, x * inv_speed * max_velocity[l], x);
+            vy[l] = laneSelect(over, y * inv_speed * max_velocity[l], y);
+            vz[l] = laneSelect(over, z * inv_speed * max_velocity[l], z);
+        }
+    }
+
+    void bounceWalls(float* __restrict p, float* __restrict v, const float* __restrict r, const float* __restrict half_size, const float* __restrict restitution) {
+        for (int l = 0; l < LANES; ++l) {
+            float h = half_size[l];
+            bool below = p[l] - r[l] < -h;
+            bool above = p[l] + r[l] > h;
+            p[l] = laneSelect(below, -h + r[l], laneSelect(above, h - r[l], p[l]));
+            v[l] = laneSelect(below | above, v[l] * -restitution[l], v[l]);
+        }
+    }
+
+    // one body pair (i, j) across all lanes, the masked equivalent of the pair loop body in simulateStep
+    void resolvePairLanes(float* __restrict px1, float* __restrict py1, float* __restrict pz1,
+                          float* __restrict vx1, float* __restrict vy1, float* __restrict vz1, const float* __restrict r1,
+                          float* __restrict px2, float* __restrict py2, float* __restrict pz2,
+                          float* __restrict vx2, float* __restrict vy2, float* __restrict vz2, const float* __restrict r2,
+                          const float* __restrict restitution, const float* __restrict min_separation) {
+        // most pairs are apart in every world, so find that out cheaply before doing the full masked solve
+        int any_hit = 0;
+        for (int l = 0; l < LANES; ++l) {
+            float dx = px2[l] - px1[l];
+            float dy = py2[l] - py1[l];
+            float dz = pz2[l] - pz1[l];
+            float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            any_hit |= (distance > 0) & (distance < r1[l] + r2[l]);
+        }
+        if (!any_hit) return;
+
+        for (int l = 0; l < LANES; ++l) {
+            float x1 = px1[l], y1 = py1[l], z1 = pz1[l];
+            float x2 = px2[l], y2 = py2[l], z2 = pz2[l];
+            float ux1 = vx1[l], uy1 = vy1[l], uz1 = vz1[l];
+            float ux2 = vx2[l], uy2 = vy2[l], uz2 = vz2[l];
+
+            float dx = x2 - x1;
+            float dy = y2 - y1;
+            float dz = z2 - z1;
+            float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            float combined_radii = r1[l] + r2[l];
+            bool hit = (distance > 0) & (distance < combined_radii);
+
+            // lanes that miss may produce inf/nan from here on, the selects throw them away
+            float nx = dx / distance;
+            float ny = dy / distance;
+            float nz = dz / distance;
+
+            float separation_distance = (combined_radii - distance) * 0.51f;
+            px1[l] = laneSelect(hit, x1 - nx * separation_distance, x1);
+            py1[l] = laneSelect(hit, y1 - ny * separation_distance, y1);
+            pz1[l] = laneSelect(hit, z1 - nz * separation_distance, z1);
+            px2[l] = laneSelect(hit, x2 + nx * separation_distance, x2);
+            py2[l] = laneSelect(hit, y2 + ny * separation_distance, y2);
+            pz2[l] = laneSelect(hit, z2 + nz * separation_distance, z2);
+
+            float vel_along_normal = (ux2 - ux1) * nx + (uy2 - uy1) * ny + (uz2 - uz1) * nz;
+            bool resolve = hit & !(vel_along_normal > 0);
+
+            float impulse_magnitude = -(1.0f + restitution[l]) * vel_along_normal / 2.0f;
+            float w1x = ux1 - impulse_magnitude * nx, w2x = ux2 + impulse_magnitude * nx;
+            float w1y = uy1 - impulse_magnitude * ny, w2y = uy2 + impulse_magnitude * ny;
+            float w1z = uz1 - impulse_magnitude * nz, w2z = uz2 + impulse_magnitude * nz;
+
+            float sx = w1x - w2x, sy = w1y - w2y, sz = w1z - w2z;
+            bool too_slow = std::sqrt(sx * sx + sy * sy + sz * sz) < min_separation[l];
+            float push = min_separation[l];
+            w1x = laneSelect(too_slow, w1x - nx * push * 0.5f, w1x); w2x = laneSelect(too_slow, w2x + nx * push * 0.5f, w2x);
+            w1y = laneSelect(too_slow, w1y - ny * push * 0.5f, w1y); w2y = laneSelect(too_slow, w2y + ny * push * 0.5f, w2y);
+            w1z = laneSelect(too_slow, w1z - nz * push * 0.5f, w1z); w2z = laneSelect(too_slow, w2z + nz * push * 0.5f, w2z);
+
+            vx1[l] = laneSelect(resolve, w1x, ux1); vx2[l] = laneSelect(resolve, w2x, ux2);
+            vy1[l] = laneSelect(resolve, w1y, uy1); vy2[l] = laneSelect(resolve, w2y, uy2);
+            vz1[l] = laneSelect(resolve, w1z, uz1); vz2[l] = laneSelect(resolve, w2z, uz2);
+        }
+    }
+
+    void loadBatch(WorldBatch& batch) {
+        size_t size = static_cast<size_t>(batch.body_count) * LANES;
+        for (auto* array : {&batch.px, &batch.py, &batch.pz, &batch.vx, &batch.vy, &batch.vz, &batch.radius}) {
+            array->assign(size, 0.0f);
+        }
+
+        // unused lanes mirror lane 0 so they do harmless, finite work and are never written back
+        for (int l = 0; l < LANES; ++l) {
+            const PhysicsWorld& world = *batch.worlds[l < batch.lane_count ? l : 0];
+            batch.half_size[l] = world.params.box_size / 2.0f;
+            batch.restitution[l] = world.params.restitution;
+            batch.damping[l] = world.params.damping;
+            batch.max_velocity[l] = world.params.max_velocity;
+            batch.min_separation[l] = world.params.min_separation_velocity;
+
+            for (int b = 0; b < batch.body_count; ++b) {
+                const SceneObject& obj = world.objects[b];
+                size_t k = static_cast<size_t>(b) * LANES + l;
+                batch.px[k] = obj.position.x;
+                batch.py[k] = obj.position.y;
+                batch.pz[k] = obj.position.z;
+                batch.vx[k] = obj.velocity.x;
+                batch.vy[k] = obj.velocity.y;
+                batch.vz[k] = obj.velocity.z;
+                batch.radius[k] = obj.radius;
+            }
+        }
+    }
+
+    void storeBatch(WorldBatch& batch) {
+        for (int l = 0; l < batch.lane_count; ++l) {
+            PhysicsWorld& world = *batch.worlds[l];
+            for (int b = 0; b < batch.body_count; ++b) {
+                SceneObject& obj = world.objects[b];
+                size_t k = static_cast<size_t>(b) * LANES + l;
+                obj.position = glm::vec3(batch.px[k], batch.py[k], batch.pz[k]);
+                obj.velocity = glm::vec3(batch.vx[k], batch.vy[k], batch.vz[k]);
+                updateModelMatrix(obj);
+            }
+        }
+    }
+
+    void simulateBatch(WorldBatch& batch, float delta_time) {
+        delta_time = std::min(delta_time, MAX_DELTA_TIME);
+        const int n = batch.body_count;
+
+        for (int b = 0; b < n; ++b) {
+            float* vx = &batch.vx[b * LANES];
+            float* vy = &batch.vy[b * LANES];
+            float* vz = &batch.vz[b * LANES];
+            for (int l = 0; l < LANES; ++l) {
+                vx[l] *= batch.damping[l];
+                vy[l] *= batch.damping[l];
+                vz[l] *= batch.damping[l];
+            }
+            clampVelocities(vx, vy, vz, batch.max_velocity);
+        }
+
+        for (size_t k = 0; k < static_cast<size_t>(n) * LANES; ++k) {
+            batch.px[k] += batch.vx[k] * delta_time;
+            batch.py[k] += batch.vy[k] * delta_time;
+            batch.pz[k] += batch.vz[k] * delta_time;
+        }
+
+        for (int b = 0; b < n; ++b) {
+            const float* r = &batch.radius[b * LANES];
+            bounceWalls(&batch.px[b * LANES], &batch.vx[b * LANES], r, batch.half_size, batch.restitution);
+            bounceWalls(&batch.py[b * LANES], &batch.vy[b * LANES], r, batch.half_size, batch.restitution);
+            bounceWalls(&batch.pz[b * LANES], &batch.vz[b * LANES], r, batch.half_size, batch.restitution);
+        }
+
+        for (int i = 0; i < n; ++i) {
+            for (int j = i + 1; j < n; ++j) {
+                size_t a = static_cast<size_t>(i) * LANES;
+                size_t b = static_cast<size_t>(j) * LANES;
+                resolvePairLanes(&batch.px[a], &batch.py[a], &batch.pz[a], &batch.vx[a], &batch.vy[a], &batch.vz[a], &batch.radius[a],
+                                 &batch.px[b], &batch.py[b], &batch.pz[b], &batch.vx[b], &batch.vy[b], &batch.vz[b], &batch.radius[b],
+                                 batch.restitution, batch.min_separation);
+            }
+        }
+
+        for (int b = 0; b < n; ++b) {
+            clampVelocities(&batch.vx[b * LANES], &batch.vy[b * LANES], &batch.vz[b * LANES], batch.max_velocity);
+        }
+    }
+
+    // SCALAR BACKENDS
+
+    inline Fixed laneSelect(bool mask, Fixed if_true, Fixed if_false) {
+        int32_t m = -static_cast<int32_t>(mask);
+        return Fixed::fromRaw((if_true.raw & m) | (if_false.raw & ~m));
+    }
+
+    inline float scalarSqrt(float value) { return std::sqrt(value); }
+    inline Fixed scalarSqrt(Fixed value) { return fixedSqrt(value); }
+
+    template <typename Real>
+    void dampAndClamp(SphereBodies<Real>& bodies, Real damping, Real max_velocity) {
+        const size_t n = bodies.size();
+        Real* __restrict vx = bodies.vx.data();
+        Real* __restrict vy = bodies.vy.data();
+        Real* __restrict vz = bodies.vz.data();
+        for (size_t i = 0; i < n; ++i) {
+            vx[i] *= damping;
+            vy[i] *= damping;
+            vz[i] *= damping;
+        }
+
+        // runaway bodies are rare, so this stays a plain branch around the divide
+        Real max_squared = max_velocity * max_velocity;
+        for (size_t i = 0; i < n; ++i) {
+            Real speed_squared = vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i];
+            if (speed_squared > max_squared) {
+                Real scale = max_velocity / scalarSqrt(speed_squared);
+                vx[i] *= scale;
+                vy[i] *= scale;
+                vz[i] *= scale;
+            }
+        }
+    }
+
+    template <typename Real>
+    void bounceWallsAxis(Real* __restrict p, Real* __restrict v, const Real* __restrict r, size_t n, Real half_size, Real restitution) {
+        for (size_t i = 0; i < n; ++i) {
+            bool below = p[i] - r[i] < -half_size;
+            bool above = p[i] + r[i] > half_size;
+            p[i] = laneSelect(below, -half_size + r[i], laneSelect(above, half_size - r[i], p[i]));
+            v[i] = laneSelect(below | above, v[i] * -restitution, v[i]);
+        }
+    }
+}
+
+PhysicsParams defaultPhysicsParams() {
+    PhysicsParams params;
+    params.box_size = CONFIG::BOX_SIZE;
+    params.damping = 1.0f; // no elasticity
+    params.restitution = 1.0f; // ^^^
+    params.max_velocity = CONFIG::ICOSPHERE_MAX_START_VELOCITY * 3.0f; // in case of runaway
+    params.min_separation_velocity = 0.01f;
+    return params;
+}
+
+void updatePhysics(std::vector<SceneObject>& objects, float delta_time) {
+    static const PhysicsParams default_params = defaultPhysicsParams();
+    updatePhysics(objects, delta_time, default_params);
+}
+
+void updatePhysics(std::vector<SceneObject>& objects, float delta_time, const PhysicsParams& params) {
+    constexpr bool STATS = CONFIG::PHYSICS_STATS;
+    PhysicsStepStats stats = {};
+    std::chrono::steady_clock::time_point step_start;
+    if constexpr (STATS) step_start = std::chrono::steady_clock::now();
+
+    simulateStep<STATS>(objects, delta_time, params, stats);
+
+    step_counter++;
+    if constexpr (STATS) {
+        stats.total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - step_start).count();
+        stats.step_index = step_counter;
+        last_stats = stats;
+    }
+}
+
+void updatePhysicsLod(std::vector<SceneObject>& objects, PhysicsLodScheduler& lod, float delta_time,
+                      const glm::vec3& camera_position, const glm::mat4& view_projection) {
+    static const PhysicsParams params = defaultPhysicsParams();
+    constexpr bool STATS = CONFIG::PHYSICS_STATS;
+    PhysicsStepStats stats = {};
+    std::chrono::steady_clock::time_point step_start;
+    if constexpr (STATS) step_start = std::chrono::steady_clock::now();
+
+    const size_t n = objects.size();
+    if (lod.tiers.size() != n) {
+        lod.tiers.resize(n, PHYSICS_TIER_FULL);
+        lod.pending_time.resize(n, 0.0f);
+        lod.rebalance_cursor = 0;
+    }
+
+    // incremental rebalance, a slice of the bodies per step
+    Frustum frustum = extractFrustum(view_projection);
+    size_t budget = std::min<size_t>(n, CONFIG::PHYSICS_LOD_REBALANCE_BUDGET);
+    for (size_t k = 0; k < budget; ++k) {
+        size_t i = lod.rebalance_cursor;
+        lod.rebalance_cursor = (lod.rebalance_cursor + 1) % n;
+
+        float distance = glm::length(objects[i].position - camera_position);
+        bool visible = sphereInFrustum(frustum, objects[i].position, objects[i].radius);
+        lod.tiers[i] = chooseTier(lod.tiers[i], distance, visible);
+    }
+
+    delta_time = std::min(delta_time, MAX_DELTA_TIME);
+    std::vector<uint8_t>& is_active = lod.is_active;
+    is_active.assign(n, 0);
+    lod.active.clear();
+    for (size_t i = 0; i < n; ++i) {
+        lod.pending_time[i] += delta_time;
+        // each body is offset by its index, so a tier's bodies are spread over its period
+        // instead of all landing on the same frame
+        uint64_t period = uint64_t(1) << lod.tiers[i];
+        if ((lod.step + i) % period == 0) {
+            is_active[i] = 1;
+            lod.active.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    // tier boundaries: anything skipped that could touch an active body (or a body
+    // pulled in earlier) joins this step, repeating until nothing else is in reach.
+    // each body's broadphase interval covers everywhere it could get to this step
+    lod.reach.entries.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        float extent = objects[i].radius + glm::length(objects[i].velocity) * lod.pending_time[i];
+        lod.reach.entries[i] = {objects[i].position.x - extent, objects[i].position.x + extent, static_cast<uint32_t>(i)};
+    }
+    buildBroadphase(lod.reach);
+
+    for (size_t next = 0; next < lod.active.size(); ++next) {
+        uint32_t a = lod.active[next];
+        float extent = objects[a].radius + glm::length(objects[a].velocity) * lod.pending_time[a];
+        queryBroadphase(lod.reach, objects[a].position.x - extent, objects[a].position.x + extent, [&](uint32_t i) {
+            if (is_active[i]) return;
+            if (mayReach(objects[a], lod.pending_time[a], objects[i], lod.pending_time[i])) {
+                is_active[i] = 1;
+                lod.active.push_back(i);
+            }
+        });
+    }
+
+    // a skipped body owes up to 1 << tier frames of time, more than MAX_DELTA_TIME. the active
+    // set is stepped in substeps small enough that no body moves further than that per step,
+    // each body covering an equal share of what it owes every substep so all finish together
+    float most_owed = 0.0f;
+    for (uint32_t i : lod.active) most_owed = std::max(most_owed, lod.pending_time[i]);
+    const int substeps = std::max(1, static_cast<int>(std::ceil(most_owed / MAX_DELTA_TIME)));
+
+    lod.active_objects.clear();
+    lod.active_delta_times.clear();
+    for (uint32_t i : lod.active) {
+        lod.active_objects.push_back(objects[i]);
+        lod.active_delta_times.push_back(lod.pending_time[i] / static_cast<float>(substeps));
+    }
+
+    for (int substep = 0; substep < substeps; ++substep) {
+        PhysicsStepStats substep_stats = {};
+        simulateStep<STATS>(lod.active_objects, delta_time, params, substep_stats, &lod.active_delta_times);
+        if constexpr (STATS) mergeSubstepStats(stats, substep_stats);
+    }
+
+    for (size_t k = 0; k < lod.active.size(); ++k) {
+        objects[lod.active[k]] = lod.active_objects[k];
+        lod.pending_time[lod.active[k]] = 0.0f;
+    }
+    lod.step++;
+
+    step_counter++;
+    if constexpr (STATS) {
+        stats.total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - step_start).count();
+        stats.step_index = step_counter;
+        stats.body_count = static_cast<uint32_t>(n);
+        stats.active_bodies = static_cast<uint32_t>(lod.active.size());
+        last_stats = stats;
+    }
+}
+
+void buildBroadphase(Broadphase& broadphase) {
+    std::sort(broadphase.entries.begin(), broadphase.entries.end(),
+              [](const BroadphaseEntry& a, const BroadphaseEntry& b) { return a.min_x < b.min_x; });
+    broadphase.max_extent = 0.0f;
+    for (const auto& entry : broadphase.entries) {
+        broadphase.max_extent = std::max(broadphase.max_extent, entry.max_x - entry.min_x);
+    }
+}
+
+void updateTriggers(TriggerSystem& triggers, const std::vector<SceneObject>& objects) {
+    std::swap(triggers.previous_offsets, triggers.inside_offsets);
+    std::swap(triggers.previous_inside, triggers.inside);
+    triggers.inside_offsets.clear();
+    triggers.inside.clear();
+    triggers.entered.clear();
+    triggers.exited.clear();
+
+    const size_t volume_count = triggers.volumes.size();
+    // volumes added since the last call start out empty
+    triggers.previous_offsets.resize(volume_count + 1, static_cast<uint32_t>(triggers.previous_inside.size()));
+    if (triggers.previous_offsets.empty()) triggers.previous_offsets.push_back(0);
+
+    triggers.broadphase.entries.resize(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i) {
+        const SceneObject& body = objects[i];
+        triggers.broadphase.entries[i] = {body.position.x - body.radius, body.position.x + body.radius, static_cast<uint32_t>(i)};
+    }
+    buildBroadphase(triggers.broadphase);
+
+    triggers.inside_offsets.push_back(0);
+    for (size_t t = 0; t < volume_count; ++t) {
+        const TriggerVolume& volume = triggers.volumes[t];
+        glm::vec3 half_extents = volumeHalfExtents(volume);
+
+        triggers.candidates.clear();
+        queryBroadphase(triggers.broadphase, volume.center.x - half_extents.x, volume.center.x + half_extents.x,
+                        [&](uint32_t body) { triggers.candidates.push_back(body); });
+        std::sort(triggers.candidates.begin(), triggers.candidates.end());
+
+        for (uint32_t body : triggers.candidates) {
+            if (bodyInsideVolume(volume, objects[body])) triggers.inside.push_back(body);
+        }
+        triggers.inside_offsets.push_back(static_cast<uint32_t>(triggers.inside.size()));
+
+        // both occupancy lists are sorted, so one merge gives the enters and exits
+        auto now = triggers.inside.begin() + triggers.inside_offsets[t];
+        auto now_end = triggers.inside.begin() + triggers.inside_offsets[t + 1];
+        auto before = triggers.previous_inside.begin() + triggers.previous_offsets[t];
+        auto before_end = triggers.previous_inside.begin() + triggers.previous_offsets[t + 1];
+        uint32_t trigger = static_cast<uint32_t>(t);
+        while (now != now_end || before != before_end) {
+            if (before == before_end || (now != now_end && *now < *before)) {
+                triggers.entered.push_back({trigger, *now++});
+            } else if (now == now_end || *before < *now) {
+                triggers.exited.push_back({trigger, *before++});
+            } else {
+                ++now;
+                ++before;
+            }
+        }
+    }
+}
+
+template <typename Real>
+SphereBodies<Real> loadSphereBodies(const std::vector<SceneObject>& objects) {
+    SphereBodies<Real> bodies;
+    for (const auto& obj : objects) {
+        bodies.px.push_back(Real(obj.position.x));
+        bodies.py.push_back(Real(obj.position.y));
+        bodies.pz.push_back(Real(obj.position.z));
+        bodies.vx.push_back(Real(obj.velocity.x));
+        bodies.vy.push_back(Real(obj.velocity.y));
+        bodies.vz.push_back(Real(obj.velocity.z));
+        bodies.radius.push_back(Real(obj.radius));
+    }
+    return bodies;
+}
+
+template <typename Real>
+void storeSphereBodies(const SphereBodies<Real>& bodies, std::vector<SceneObject>& objects) {
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        SceneObject& obj = objects[i];
+        obj.position = glm::vec3(float(bodies.px[i]), float(bodies.py[i]), float(bodies.pz[i]));
+        obj.velocity = glm::vec3(float(bodies.vx[i]), float(bodies.vy[i]), float(bodies.vz[i]));
+        updateModelMatrix(obj);
+    }
+}
+
+template <typename Real>
+void stepSphereBodies(SphereBodies<Real>& bodies, float delta_time, const PhysicsParams& params) {
+    const size_t n = bodies.size();
+    const Real dt = Real(std::min(delta_time, MAX_DELTA_TIME));
+    const Real half_size = Real(params.box_size / 2.0f);
+    const Real restitution = Real(params.restitution);
+    const Real max_velocity = Real(params.max_velocity);
+    const Real min_separation = Real(params.min_separation_velocity);
+    const Real zero = Real(0.0f);
+    const Real half = Real(0.5f);
+    const Real push_fraction = Real(0.51f);
+    const Real impulse_scale = -(Real(1.0f) + restitution) * half;
+
+    dampAndClamp(bodies, Real(params.damping), max_velocity);
+
+    {
+        Real* __restrict px = bodies.px.data();
+        Real* __restrict py = bodies.py.data();
+        Real* __restrict pz = bodies.pz.data();
+        const Real* __restrict vx = bodies.vx.data();
+        const Real* __restrict vy = bodies.vy.data();
+        const Real* __restrict vz = bodies.vz.data();
+        for (size_t i = 0; i < n; ++i) {
+            px[i] += vx[i] * dt;
+            py[i] += vy[i] * dt;
+            pz[i] += vz[i] * dt;
+        }
+    }
+
+    bounceWallsAxis(bodies.px.data(), bodies.vx.data(), bodies.radius.data(), n, half_size, restitution);
+    bounceWallsAxis(bodies.py.data(), bodies.vy.data(), bodies.radius.data(), n, half_size, restitution);
+    bounceWallsAxis(bodies.pz.data(), bodies.vz.data(), bodies.radius.data(), n, half_size, restitution);
+
+    // sequential contact pass, same order and rules as updatePhysics. the squared distance
+    // test rejects most pairs before the square root
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = i + 1; j < n; ++j) {
+            Real dx = bodies.px[j] - bodies.px[i];
+            Real dy = bodies.py[j] - bodies.py[i];
+            Real dz = bodies.pz[j] - bodies.pz[i];
+            Real combined_radii = bodies.radius[i] + bodies.radius[j];
+            Real distance_squared = dx * dx + dy * dy + dz * dz;
+            if (!(distance_squared < combined_radii * combined_radii)) continue;
+
+            Real distance = scalarSqrt(distance_squared);
+            if (!(distance > zero)) continue;
+
+            Real nx = dx / distance;
+            Real ny = dy / distance;
+            Real nz = dz / distance;
+
+            Real separation_distance = (combined_radii - distance) * push_fraction;
+            bodies.px[i] -= nx * separation_distance; bodies.px[j] += nx * separation_distance;
+            bodies.py[i] -= ny * separation_distance; bodies.py[j] += ny * separation_distance;
+            bodies.pz[i] -= nz * separation_distance; bodies.pz[j] += nz * separation_distance;
+
+            Real vel_along_normal = (bodies.vx[j] - bodies.vx[i]) * nx + (bodies.vy[j] - bodies.vy[i]) * ny + (bodies.vz[j] - bodies.vz[i]) * nz;
+            if (vel_along_normal > zero) continue;
+
+            Real impulse_magnitude = impulse_scale * vel_along_normal;
+            bodies.vx[i] -= impulse_magnitude * nx; bodies.vx[j] += impulse_magnitude * nx;
+            bodies.vy[i] -= impulse_magnitude * ny; bodies.vy[j] += impulse_magnitude * ny;
+            bodies.vz[i] -= impulse_magnitude * nz; bodies.vz[j] += impulse_magnitude * nz;
+
+            Real sx = bodies.vx[i] - bodies.vx[j];
+            Real sy = bodies.vy[i] - bodies.vy[j];
+            Real sz = bodies.vz[i] - bodies.vz[j];
+            if (sx * sx + sy * sy + sz * sz < min_separation * min_separation) {
+                Real push = min_separation * half;
+                bodies.vx[i] -= nx * push; bodies.vx[j] += nx * push;
+                bodies.vy[i] -= ny * push; bodies.vy[j] += ny * push;
+                bodies.vz[i] -= nz * push; bodies.vz[j] += nz * push;
+            }
+        }
+    }
+
+    dampAndClamp(bodies, Real(1.0f), max_velocity);
+}
+
+template SphereBodies<float> loadSphereBodies<float>(const std::vector<SceneObject>&);
+template SphereBodies<Fixed> loadSphereBodies<Fixed>(const std::vector<SceneObject>&);
+template void storeSphereBodies<float>(const SphereBodies<float>&, std::vector<SceneObject>&);
+template void storeSphereBodies<Fixed>(const SphereBodies<Fixed>&, std::vector<SceneObject>&);
+template void stepSphereBodies<float>(SphereBodies<float>&, float, const PhysicsParams&);
+template void stepSphereBodies<Fixed>(SphereBodies<Fixed>&, float, const PhysicsParams&);
+
+const PhysicsStepStats& getPhysicsStats() {
+    return last_stats;
+}
+
+PhysicsWorld createRandomWorld(uint32_t seed, int body_count, float radius, const PhysicsParams& params) {
+    std::mt19937 generator(seed);
+    float pos_range = params.box_size / 2.0f - radius * 2.0f;
+    std::uniform_real_distribution<float> position(-pos_range, pos_range);
+    std::uniform_real_distribution<float> velocity(-CONFIG::ICOSPHERE_MAX_START_VELOCITY, CONFIG::ICOSPHERE_MAX_START_VELOCITY);
+
+    PhysicsWorld world;
+    world.params = params;
+    world.objects.reserve(body_count);
+    for (int i = 0; i < body_count; ++i) {
+        SceneObject body;
+        body.mesh_data = nullptr;
+        body.radius = radius;
+        body.position = glm::vec3(position(generator), position(generator), position(generator));
+        body.velocity = glm::vec3(velocity(generator), velocity(generator), velocity(generator));
+        world.objects.push_back(body);
+    }
+    return world;
+}
+
+void stepPhysicsWorlds(std::vector<PhysicsWorld>& worlds, float delta_time, int step_count, unsigned thread_count) {
+    // a job is either a full simd batch of same-sized worlds or a lone world on the scalar path
+    std::map<size_t, std::vector<PhysicsWorld*>> by_body_count;
+    for (auto& world : worlds) {
+        by_body_count[world.objects.size()].push_back(&world);
+    }
+
+    std::vector<WorldBatch> batches;
+    std::vector<PhysicsWorld*> singles;
+    for (auto& [body_count, group] : by_body_count) {
+        for (size_t start = 0; start < group.size(); start += LANES) {
+            size_t lane_count = std::min<size_t>(LANES, group.size() - start);
+            if (lane_count == 1 || body_count == 0) {
+                singles.insert(singles.end(), group.begin() + start, group.begin() + start + lane_count);
+                continue;
+            }
+            WorldBatch& batch = batches.emplace_back();
+            batch.body_count = static_cast<int>(body_count);
+            batch.lane_count = static_cast<int>(lane_count);
+            std::copy_n(group.begin() + start, lane_count, batch.worlds);
+        }
+    }
+
+    const size_t job_count = batches.size() + singles.size();
+    if (thread_count == 0) thread_count = std::max(1u, std::thread::hardware_concurrency());
+    thread_count = static_cast<unsigned>(std::min<size_t>(thread_count, job_count));
+
+    std::atomic<size_t> next_job = 0;
+    auto worker = [&]() {
+        PhysicsStepStats unused_stats = {};
+        for (size_t job = next_job++; job < job_count; job = next_job++) {
+            if (job < batches.size()) {
+                WorldBatch& batch = batches[job];
+                // triggers read the objects, so those batches are written back every step
+                bool has_triggers = false;
+                for (int l = 0; l < batch.lane_count; ++l) has_triggers |= !batch.worlds[l]->triggers.volumes.empty();
+
+                loadBatch(batch);
+                for (int step = 0; step < step_count; ++step) {
+                    simulateBatch(batch, delta_time);
+                    if (!has_triggers) continue;
+                    storeBatch(batch);
+                    for (int l = 0; l < batch.lane_count; ++l) {
+                        PhysicsWorld* world = batch.worlds[l];
+                        if (!world->triggers.volumes.empty()) updateTriggers(world->triggers, world->objects);
+                    }
+                }
+                if (!has_triggers) storeBatch(batch);
+            } else {
+                PhysicsWorld* world = singles[job - batches.size()];
+                for (int step = 0; step < step_count; ++step) {
+                    simulateStep<false>(world->objects, delta_time, world->params, unused_stats);
+                    if (!world->triggers.volumes.empty()) updateTriggers(world->triggers, world->objects);
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < thread_count; ++t) threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads) thread.join();
+}
@@ -0,0 +1,551 @@
+#include "../include/glad/glad.h"
+#include "../include/render.hpp"
+#include "../include/config.hpp"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <unordered_map>
+
+namespace {
+    constexpr int NORMAL_MATRIX_LANES = 8;
+
+    // normal matrices for NORMAL_MATRIX_LANES instances at once, upper 3x3s in [element][lane]
+    // order (column major). with model columns a, b, c the inverse has rows b x c, c x a and
+    // a x b over det = a . (b x c), so the inverse transpose has them as columns. straight
+    // line lane loop so it vectorises like the batched physics kernel
+    void normalMatrixLanes(const float* __restrict m, float* __restrict n) {
+        constexpr int L = NORMAL_MATRIX_LANES;
+        for (int l = 0; l < L; ++l) {
+            float ax = m[0 * L + l], ay = m[1 * L + l], az = m[2 * L + l];
+            float bx = m[3 * L + l], by = m[4 * L + l], bz = m[5 * L + l];
+            float cx = m[6 * L + l], cy = m[7 * L + l], cz = m[8 * L + l];
+
+            float bc_x = by * cz - bz * cy, bc_y = bz * cx - bx * cz, bc_z = bx * cy - by * cx;
+            float ca_x = cy * az - cz * ay, ca_y = cz * ax - cx * az, ca_z = cx * ay - cy * ax;
+            float ab_x = ay * bz - az * by, ab_y = az * bx - ax * bz, ab_z = ax * by - ay * bx;
+
+            float inverse_det = 1.0f / (ax * bc_x + ay * bc_y + az * bc_z);
+
+            n[0 * L + l] = bc_x * inverse_det; n[1 * L + l] = bc_y * inverse_det; n[2 * L + l] = bc_z * inverse_det;
+            n[3 * L + l] = ca_x * inverse_det; n[4 * L + l] = ca_y * inverse_det; n[5 * L + l] = ca_z * inverse_det;
+            n[6 * L + l] = ab_x * inverse_det; n[7 * L + l] = ab_y * inverse_det; n[8 * L + l] = ab_z * inverse_det;
+        }
+    }
+
+    // model_of(i) returns the i'th model matrix. normals are gathered in batches of
+    // NORMAL_MATRIX_LANES, the short tail batch is padded with identity so nothing divides by 0
+    template <typename ModelOf>
+    void writeInstances(InstanceData* out, unsigned int count, bool uniform_scale, uint32_t texture_layer, ModelOf model_of) {
+        for (unsigned int i = 0; i < count; ++i) {
+            out[i].model = model_of(i);
+            out[i].texture_layer = texture_layer;
+        }
+        if (uniform_scale) return;
+
+        constexpr int L = NORMAL_MATRIX_LANES;
+        alignas(32) float upper[9 * L];
+        alignas(32) float normals[9 * L];
+        for (unsigned int batch = 0; batch < count; batch += L) {
+            unsigned int lanes = std::min<unsigned int>(L, count - batch);
+            for (int l = 0; l < L; ++l) {
+                const bool live = static_cast<unsigned int>(l) < lanes;
+                for (int column = 0; column < 3; ++column) {
+                    for (int row = 0; row < 3; ++row) {
+                        upper[(column * 3 + row) * L + l] = live ? out[batch + l].model[column][row] : float(column == row);
+                    }
+                }
+            }
+
+            normalMatrixLanes(upper, normals);
+
+            for (unsigned int l = 0; l < lanes; ++l) {
+                for (int column = 0; column < 3; ++column) {
+                    out[batch + l].normal_matrix[column] = glm::vec4(normals[(column * 3 + 0) * L + l],
+                                                                     normals[(column * 3 + 1) * L + l],
+                                                                     normals[(column * 3 + 2) * L + l], 0.0f);
+                }
+            }
+        }
+    }
+
+    InstanceRange allocateInstances(RingBuffer* ring, unsigned int count, InstanceData*& out) {
+        InstanceRange range;
+        RingAllocation allocation = ringAllocate(ring, count * sizeof(InstanceData), sizeof(InstanceData));
+        out = static_cast<InstanceData*>(allocation.data);
+        if (!out) return range;
+
+        range.base_instance = allocation.offset / sizeof(InstanceData);
+        range.count = count;
+        return range;
+    }
+
+    // only the first wait needs to flush, after that the fence is already queued
+    void waitRingFence(GLsync& fence) {
+        if (!fence) return;
+        GLbitfield wait_flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        const GLuint64 ONE_SECOND = 1000000000;
+        while (true) {
+            GLenum result = glClientWaitSync(fence, wait_flags, ONE_SECOND);
+            if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) break;
+            if (result == GL_WAIT_FAILED) {
+                std::cerr << "Waiting on a streaming buffer fence failed" << std::endl;
+                break;
+            }
+            wait_flags = 0;
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    void allocateRingStorage(RingBuffer* ring) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        const GLsizeiptr total = static_cast<GLsizeiptr>(ring->frame_size) * RING_FRAMES;
+
+        glGenBuffers(1, &ring->buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, ring->buffer);
+        glBufferStorage(GL_ARRAY_BUFFER, total, nullptr, flags);
+        ring->mapped = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags));
+        if (!ring->mapped) {
+            std::cerr << "Failed to persistently map the streaming buffer" << std::endl;
+        }
+    }
+
+    void releaseRingStorage(RingBuffer* ring) {
+        glBindBuffer(GL_ARRAY_BUFFER, ring->buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glDeleteBuffers(1, &ring->buffer);
+        ring->buffer = 0;
+        ring->mapped = nullptr;
+    }
+}
+
+RingBuffer* createRingBuffer(unsigned int frame_size) {
+    RingBuffer* ring = new RingBuffer();
+
+    int alignment = 0, storage_alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_alignment);
+    // segments start on an alignment that satisfies uniform and storage binds as well as
+    // instance base instances
+    ring->uniform_alignment = std::max<unsigned int>({static_cast<unsigned int>(alignment > 0 ? alignment : 256),
+                                                      static_cast<unsigned int>(std::max(storage_alignment, 0)),
+                                                      static_cast<unsigned int>(sizeof(InstanceData))});
+    ring->frame_size = (frame_size + ring->uniform_alignment - 1) / ring->uniform_alignment * ring->uniform_alignment;
+    allocateRingStorage(ring);
+    return ring;
+}
+
+void destroyRingBuffer(RingBuffer* ring) {
+    for (GLsync& fence : ring->fences) {
+        if (fence) glDeleteSync(fence);
+    }
+    releaseRingStorage(ring);
+    delete ring;
+}
+
+bool beginRingFrame(RingBuffer* ring) {
+    // the last frame overflowed, so nothing may still be reading any segment before the
+    // buffer is replaced. half again as much leaves room for the scene to keep growing
+    const bool grow = ring->requested > ring->frame_size;
+    if (grow) {
+        for (GLsync& fence : ring->fences) waitRingFence(fence);
+        const unsigned int wanted = ring->requested + ring->requested / 2;
+        ring->frame_size = (wanted + ring->uniform_alignment - 1) / ring->uniform_alignment * ring->uniform_alignment;
+        releaseRingStorage(ring);
+        allocateRingStorage(ring);
+        std::cerr << "Streaming buffer grown to " << ring->frame_size << " bytes per frame" << std::endl;
+    }
+
+    ring->frame = (ring->frame + 1) % RING_FRAMES;
+    ring->head = 0;
+    ring->requested = 0;
+    waitRingFence(ring->fences[ring->frame]);
+    return grow;
+}
+
+void endRingFrame(RingBuffer* ring) {
+    ring->fences[ring->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+RingAllocation ringAllocate(RingBuffer* ring, unsigned int size, unsigned int alignment) {
+    RingAllocation allocation;
+    unsigned int start = (ring->head + alignment - 1) & ~(alignment - 1);
+    ring->requested = ((ring->requested + alignment - 1) & ~(alignment - 1)) + size;
+    if (!ring->mapped || start + size > ring->frame_size) {
+        std::cerr << "Streaming buffer segment full, " << size << " bytes dropped this frame" << std::endl;
+        return allocation;
+    }
+
+    ring->head = start + size;
+    allocation.offset = ring->frame * ring->frame_size + start;
+    allocation.data = ring->mapped + allocation.offset;
+    allocation.size = size;
+    return allocation;
+}
+
+InstanceRange uploadInstances(RingBuffer* ring, const std::vector<SceneObject>& objects, bool uniform_scale, uint32_t texture_layer) {
+    InstanceData* out = nullptr;
+    unsigned int count = static_cast<unsigned int>(objects.size());
+    InstanceRange range = allocateInstances(ring, count, out);
+    if (out) writeInstances(out, count, uniform_scale, texture_layer, [&](unsigned int i) { return objects[i].model_matrix; });
+    return range;
+}
+
+InstanceRange uploadInstances(RingBuffer* ring, const std::vector<SceneObject>& objects, const std::vector<uint32_t>& indices, bool uniform_scale, uint32_t texture_layer) {
+    InstanceData* out = nullptr;
+    unsigned int count = static_cast<unsigned int>(indices.size());
+    InstanceRange range = allocateInstances(ring, count, out);
+    if (out) writeInstances(out, count, uniform_scale, texture_layer, [&](unsigned int i) { return objects[indices[i]].model_matrix; });
+    return range;
+}
+
+InstanceRange uploadInstances(RingBuffer* ring, const glm::mat4* matrices, unsigned int count, bool uniform_scale, uint32_t texture_layer) {
+    InstanceData* out = nullptr;
+    InstanceRange range = allocateInstances(ring, count, out);
+    if (out) writeInstances(out, count, uniform_scale, texture_layer, [&](unsigned int i) { return matrices[i]; });
+    return range;
+}
+
+RangeAllocator createRangeAllocator(unsigned int capacity) {
+    RangeAllocator allocator;
+    allocator.capacity = capacity;
+    allocator.free_ranges.push_back({0, capacity});
+    return allocator;
+}
+
+bool allocateRange(RangeAllocator& allocator, unsigned int count, unsigned int& offset) {
+    for (size_t i = 0; i < allocator.free_ranges.size(); ++i) {
+        PoolRange& range = allocator.free_ranges[i];
+        if (range.count < count) continue;
+
+        offset = range.offset;
+        range.offset += count;
+        range.count -= count;
+        if (range.count == 0) allocator.free_ranges.erase(allocator.free_ranges.begin() + i);
+        return true;
+    }
+    return false;
+}
+
+void freeRange(RangeAllocator& allocator, unsigned int offset, unsigned int count) {
+    if (count == 0) return;
+    auto& ranges = allocator.free_ranges;
+    auto it = std::lower_bound(ranges.begin(), ranges.end(), offset,
+        [](const PoolRange& range, unsigned int value) { return range.offset < value; });
+    it = ranges.insert(it, {offset, count});
+
+    // merge with the following range, then with the preceding one
+    auto next = it + 1;
+    if (next != ranges.end() && it->offset + it->count == next->offset) {
+        it->count += next->count;
+        ranges.erase(next);
+    }
+    if (it != ranges.begin()) {
+        auto previous = it - 1;
+        if (previous->offset + previous->count == it->offset) {
+            previous->count += it->count;
+            ranges.erase(it);
+        }
+    }
+}
+
+GeometryPool* createGeometryPool(unsigned int vertex_capacity, unsigned int index_capacity) {
+    GeometryPool* pool = new GeometryPool();
+    pool->vertices = createRangeAllocator(vertex_capacity);
+    pool->indices = createRangeAllocator(index_capacity);
+
+    const GLsizei stride = CONFIG::VERTEX_LENGTH * sizeof(float);
+    glCreateBuffers(1, &pool->vbo);
+    glNamedBufferStorage(pool->vbo, static_cast<GLsizeiptr>(vertex_capacity) * stride, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glCreateBuffers(1, &pool->ibo);
+    glNamedBufferStorage(pool->ibo, static_cast<GLsizeiptr>(index_capacity) * sizeof(unsigned int), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+    glCreateVertexArrays(1, &pool->vao);
+    glVertexArrayVertexBuffer(pool->vao, 0, pool->vbo, 0, stride);
+    glVertexArrayElementBuffer(pool->vao, pool->ibo);
+
+    const GLint sizes[3] = {3, 3, 2};
+    const GLuint offsets[3] = {0, 3 * sizeof(float), 6 * sizeof(float)};
+    for (unsigned int location = 0; location < 3; ++location) {
+        glEnableVertexArrayAttrib(pool->vao, location);
+        glVertexArrayAttribFormat(pool->vao, location, sizes[location], GL_FLOAT, GL_FALSE, offsets[location]);
+        glVertexArrayAttribBinding(pool->vao, location, 0);
+    }
+
+    glCreateBuffers(1, &pool->position_vbo);
+    glNamedBufferStorage(pool->position_vbo, static_cast<GLsizeiptr>(vertex_capacity) * sizeof(glm::vec3), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glCreateVertexArrays(1, &pool->depth_vao);
+    glVertexArrayVertexBuffer(pool->depth_vao, 0, pool->position_vbo, 0, sizeof(glm::vec3));
+    glVertexArrayElementBuffer(pool->depth_vao, pool->ibo);
+    glEnableVertexArrayAttrib(pool->depth_vao, 0);
+    glVertexArrayAttribFormat(pool->depth_vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribBinding(pool->depth_vao, 0, 0);
+    return pool;
+}
+
+void destroyGeometryPool(GeometryPool* pool) {
+    glDeleteVertexArrays(1, &pool->vao);
+    glDeleteVertexArrays(1, &pool->depth_vao);
+    glDeleteBuffers(1, &pool->vbo);
+    glDeleteBuffers(1, &pool->position_vbo);
+    glDeleteBuffers(1, &pool->ibo);
+    delete pool;
+}
+
+Mesh* uploadMesh(GeometryPool* pool, const std::vector<float>& vertices, const std::vector<std::vector<unsigned int>>& lod_indices) {
+    unsigned int vertex_count = static_cast<unsigned int>(vertices.size() / CONFIG::VERTEX_LENGTH);
+    unsigned int lod_count = std::min<unsigned int>(static_cast<unsigned int>(lod_indices.size()), MAX_MESH_LODS);
+    unsigned int index_count = 0;
+    for (unsigned int lod = 0; lod < lod_count; ++lod) index_count += static_cast<unsigned int>(lod_indices[lod].size());
+    if (lod_count == 0) {
+        std::cerr << "attempted to upload a mesh with no index lists" << std::endl;
+        return nullptr;
+    }
+
+    unsigned int base_vertex = 0, first_index = 0;
+    if (!allocateRange(pool->vertices, vertex_count, base_vertex)) {
+        std::cerr << "Geometry pool out of vertex space for " << vertex_count << " vertices" << std::endl;
+        return nullptr;
+    }
+    if (!allocateRange(pool->indices, index_count, first_index)) {
+        std::cerr << "Geometry pool out of index space for " << index_count << " indices" << std::endl;
+        freeRange(pool->vertices, base_vertex, vertex_count);
+        return nullptr;
+    }
+
+    const GLsizeiptr stride = CONFIG::VERTEX_LENGTH * sizeof(float);
+    glNamedBufferSubData(pool->vbo, base_vertex * stride, vertex_count * stride, vertices.data());
+
+    std::vector<glm::vec3> positions(vertex_count);
+    for (unsigned int v = 0; v < vertex_count; ++v) {
+        const float* vertex = &vertices[v * CONFIG::VERTEX_LENGTH];
+        positions[v] = glm::vec3(vertex[0], vertex[1], vertex[2]);
+    }
+    glNamedBufferSubData(pool->position_vbo, base_vertex * sizeof(glm::vec3), vertex_count * sizeof(glm::vec3), positions.data());
+
+    Mesh* mesh = new Mesh();
+    mesh->base_vertex = base_vertex;
+    mesh->vertex_count = vertex_count;
+    mesh->first_index = first_index;
+    mesh->index_count = index_count;
+    mesh->lod_count = lod_count;
+
+    // lods sit back to back in the mesh's index range
+    unsigned int lod_first = first_index;
+    for (unsigned int lod = 0; lod < lod_count; ++lod) {
+        const std::vector<unsigned int>& indices = lod_indices[lod];
+        glNamedBufferSubData(pool->ibo, lod_first * sizeof(unsigned int), indices.size() * sizeof(unsigned int), indices.data());
+        mesh->lods[lod].first_index = lod_first;
+        mesh->lods[lod].index_count = static_cast<unsigned int>(indices.size());
+        lod_first += static_cast<unsigned int>(indices.size());
+    }
+
+    // centre of the aabb, then the farthest vertex from it. not the tightest sphere but close
+    // enough for culling and a single pass over the positions
+    if (vertex_count > 0) {
+        glm::vec3 lower(vertices[0], vertices[1], vertices[2]);
+        glm::vec3 upper = lower;
+        for (unsigned int v = 0; v < vertex_count; ++v) {
+            const float* position = &vertices[v * CONFIG::VERTEX_LENGTH];
+            glm::vec3 point(position[0], position[1], position[2]);
+            lower = glm::min(lower, point);
+            upper = glm::max(upper, point);
+        }
+        mesh->bounds_center = (lower + upper) * 0.5f;
+
+        float radius_squared = 0.0f;
+        for (unsigned int v = 0; v < vertex_count; ++v) {
+            const float* position = &vertices[v * CONFIG::VERTEX_LENGTH];
+            glm::vec3 offset = glm::vec3(position[0], position[1], position[2]) - mesh->bounds_center;
+            radius_squared = std::max(radius_squared, glm::dot(offset, offset));
+        }
+        mesh->bounds_radius = std::sqrt(radius_squared);
+    }
+    return mesh;
+}
+
+namespace {
+    struct VertexKey {
+        float values[CONFIG::VERTEX_LENGTH];
+
+        bool operator==(const VertexKey& other) const {
+            return std::memcmp(values, other.values, sizeof(values)) == 0;
+        }
+    };
+
+    // fnv-1a over the raw bytes, matching the bitwise equality above
+    struct VertexKeyHash {
+        size_t operator()(const VertexKey& key) const {
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(key.values);
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < sizeof(key.values); ++i) {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            }
+            return static_cast<size_t>(hash);
+        }
+    };
+}
+
+void weldVertices(const std::vector<float>& corners, std::vector<float>& vertices, std::vector<unsigned int>& indices) {
+    const size_t corner_count = corners.size() / CONFIG::VERTEX_LENGTH;
+    vertices.clear();
+    indices.clear();
+    indices.reserve(corner_count);
+
+    std::unordered_map<VertexKey, unsigned int, VertexKeyHash> unique;
+    unique.reserve(corner_count);
+    for (size_t c = 0; c < corner_count; ++c) {
+        VertexKey key;
+        std::memcpy(key.values, &corners[c * CONFIG::VERTEX_LENGTH], sizeof(key.values));
+
+        auto [it, inserted] = unique.emplace(key, static_cast<unsigned int>(unique.size()));
+        if (inserted) vertices.insert(vertices.end(), std::begin(key.values), std::end(key.values));
+        indices.push_back(it->second);
+    }
+}
+
+std::vector<std::vector<unsigned int>> buildLodChain(const std::vector<float>& vertices, const std::vector<unsigned int>& indices,
+                                                     int max_levels, int base_grid) {
+    std::vector<std::vector<unsigned int>> chain = {indices};
+    const size_t vertex_count = vertices.size() / CONFIG::VERTEX_LENGTH;
+    if (vertex_count == 0) return chain;
+
+    glm::vec3 lower(vertices[0], vertices[1], vertices[2]);
+    glm::vec3 upper = lower;
+    for (size_t v = 0; v < vertex_count; ++v) {
+        const float* position = &vertices[v * CONFIG::VERTEX_LENGTH];
+        lower = glm::min(lower, glm::vec3(position[0], position[1], position[2]));
+        upper = glm::max(upper, glm::vec3(position[0], position[1], position[2]));
+    }
+    const glm::vec3 extent = glm::max(upper - lower, glm::vec3(1e-6f));
+
+    std::vector<unsigned int> representative(vertex_count);
+    std::unordered_map<uint64_t, unsigned int> cells;
+    for (int grid = base_grid; grid >= 1 && static_cast<int>(chain.size()) < max_levels; grid /= 2) {
+        // the first vertex seen in a cell stands in for every vertex in it
+        cells.clear();
+        for (size_t v = 0; v < vertex_count; ++v) {
+            const float* position = &vertices[v * CONFIG::VERTEX_LENGTH];
+            glm::vec3 cell = (glm::vec3(position[0], position[1], position[2]) - lower) / extent * static_cast<float>(grid);
+            uint64_t x = static_cast<uint64_t>(std::min(static_cast<int>(cell.x), grid - 1));
+            uint64_t y = static_cast<uint64_t>(std::min(static_cast<int>(cell.y), grid - 1));
+            uint64_t z = static_cast<uint64_t>(std::min(static_cast<int>(cell.z), grid - 1));
+            auto it = cells.emplace((x << 42) | (y << 21) | z, static_cast<unsigned int>(v)).first;
+            representative[v] = it->second;
+        }
+
+        std::vector<unsigned int> decimated;
+        const std::vector<unsigned int>& source = chain.back();
+        for (size_t t = 0; t + 2 < source.size(); t += 3) {
+            unsigned int a = representative[source[t]], b = representative[source[t + 1]], c = representative[source[t + 2]];
+            if (a == b || b == c || a == c) continue;
+            decimated.insert(decimated.end(), {a, b, c});
+        }
+
+        // every triangle collapsed, so any coarser grid would collapse them too
+        if (decimated.empty()) break;
+        // a grid too fine to merge anything just moves on to the next coarser one
+        if (decimated.size() < source.size()) chain.push_back(std::move(decimated));
+    }
+    return chain;
+}
+
+void freeMesh(GeometryPool* pool, Mesh* mesh) {
+    freeRange(pool->vertices, mesh->base_vertex, mesh->vertex_count);
+    freeRange(pool->indices, mesh->first_index, mesh->index_count);
+    delete mesh;
+}
+
+void attachInstanceStream(GeometryPool* pool, const RingBuffer* ring) {
+    const unsigned int INSTANCE_BINDING = 1;
+    // the depth vao only needs the model matrix
+    for (unsigned int vao : {pool->vao, pool->depth_vao}) {
+        glVertexArrayVertexBuffer(vao, INSTANCE_BINDING, ring->buffer, 0, sizeof(InstanceData));
+        glVertexArrayBindingDivisor(vao, INSTANCE_BINDING, 1);
+
+        // a mat4 attribute takes four consecutive locations, a mat3 three
+        for (unsigned int column = 0; column < 4; ++column) {
+            unsigned int location = INSTANCE_MODEL_LOCATION + column;
+            glEnableVertexArrayAttrib(vao, location);
+            glVertexArrayAttribFormat(vao, location, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData, model) + column * sizeof(glm::vec4));
+            glVertexArrayAttribBinding(vao, location, INSTANCE_BINDING);
+        }
+    }
+    for (unsigned int column = 0; column < 3; ++column) {
+        unsigned int location = INSTANCE_NORMAL_LOCATION + column;
+        glEnableVertexArrayAttrib(pool->vao, location);
+        glVertexArrayAttribFormat(pool->vao, location, 3, GL_FLOAT, GL_FALSE, offsetof(InstanceData, normal_matrix) + column * sizeof(glm::vec4));
+        glVertexArrayAttribBinding(pool->vao, location, INSTANCE_BINDING);
+    }
+    // integer attribute, the I variant keeps it from being converted to float
+    glEnableVertexArrayAttrib(pool->vao, INSTANCE_TEXTURE_LOCATION);
+    glVertexArrayAttribIFormat(pool->vao, INSTANCE_TEXTURE_LOCATION, 1, GL_UNSIGNED_INT, offsetof(InstanceData, texture_layer));
+    glVertexArrayAttribBinding(pool->vao, INSTANCE_TEXTURE_LOCATION, INSTANCE_BINDING);
+}
+
+DrawElementsIndirectCommand makeDrawCommand(const Mesh* mesh, const InstanceRange& instances, unsigned int lod) {
+    const MeshLod& range = mesh->lods[std::min(lod, mesh->lod_count - 1)];
+    DrawElementsIndirectCommand command;
+    command.count = range.index_count;
+    command.instance_count = instances.count;
+    command.first_index = range.first_index;
+    command.base_vertex = static_cast<int>(mesh->base_vertex);
+    command.base_instance = instances.base_instance;
+    return command;
+}
+
+void submitDraws(RingBuffer* ring, const std::vector<DrawElementsIndirectCommand>& commands) {
+    if (commands.empty()) return;
+    unsigned int bytes = static_cast<unsigned int>(commands.size() * sizeof(DrawElementsIndirectCommand));
+    RingAllocation allocation = ringAllocate(ring, bytes, alignof(DrawElementsIndirectCommand));
+    if (!allocation.data) return;
+
+    std::memcpy(allocation.data, commands.data(), bytes);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring->buffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(uintptr_t)allocation.offset,
+                                static_cast<GLsizei>(commands.size()), 0);
+}
+
+void updateFrameUniforms(RingBuffer* ring, const FrameUniforms& values) {
+    RingAllocation allocation = ringAllocate(ring, sizeof(FrameUniforms), ring->uniform_alignment);
+    if (!allocation.data) return;
+
+    std::memcpy(allocation.data, &values, sizeof(FrameUniforms));
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, ring->buffer, allocation.offset, sizeof(FrameUniforms));
+}
+
+MaterialLibrary* createMaterialLibrary(const std::vector<MaterialUniforms>& materials) {
+    int alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment <= 0) alignment = 256;
+
+    MaterialLibrary* library = new MaterialLibrary();
+    library->count = static_cast<unsigned int>(materials.size());
+    library->stride = (static_cast<unsigned int>(sizeof(MaterialUniforms)) + alignment - 1) / alignment * alignment;
+
+    std::vector<unsigned char> packed(static_cast<size_t>(library->stride) * (materials.empty() ? 1 : materials.size()), 0);
+    for (size_t i = 0; i < materials.size(); ++i) {
+        std::memcpy(packed.data() + i * library->stride, &materials[i], sizeof(MaterialUniforms));
+    }
+
+    glGenBuffers(1, &library->ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, library->ubo);
+    glBufferStorage(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(packed.size()), packed.data(), 0);
+    return library;
+}
+
+void destroyMaterialLibrary(MaterialLibrary* library) {
+    glDeleteBuffers(1, &library->ubo);
+    delete library;
+}
+
+void bindMaterial(const MaterialLibrary* library, unsigned int index) {
+    glBindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_UNIFORM_BINDING, library->ubo,
+                      static_cast<GLintptr>(index) * library->stride, sizeof(MaterialUniforms));
+}
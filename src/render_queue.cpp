@@ -0,0 +1,169 @@
+#include "../include/glad/glad.h"
+#include "../include/render_queue.hpp"
+#include "../include/textures.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+    // least significant digit first, 8 bits per pass. a pass whose digit is the same for
+    // every key is skipped, which is most of them when few programs and textures exist
+    void radixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& order,
+                   std::vector<uint64_t>& scratch_keys, std::vector<uint32_t>& scratch_order) {
+        const size_t count = keys.size();
+        scratch_keys.resize(count);
+        scratch_order.resize(count);
+
+        for (int shift = 0; shift < 64; shift += 8) {
+            uint32_t offsets[256] = {};
+            for (uint64_t key : keys) ++offsets[(key >> shift) & 0xFF];
+            if (std::any_of(std::begin(offsets), std::end(offsets), [&](uint32_t c) { return c == count; })) continue;
+
+            uint32_t running = 0;
+            for (uint32_t& offset : offsets) {
+                uint32_t bucket = offset;
+                offset = running;
+                running += bucket;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                uint32_t slot = offsets[(keys[i] >> shift) & 0xFF]++;
+                scratch_keys[slot] = keys[i];
+                scratch_order[slot] = order[i];
+            }
+            keys.swap(scratch_keys);
+            order.swap(scratch_order);
+        }
+    }
+
+    bool sameBatch(const RenderItem& a, const RenderItem& b) {
+        return a.pass == b.pass && a.program == b.program && a.texture == b.texture && a.material == b.material;
+    }
+
+    // counts the binds a walk over items in this order needs, the same rules submitRenderQueue uses
+    RenderStateChanges countStateChanges(const std::vector<RenderItem>& items, const std::vector<uint32_t>* order) {
+        RenderStateChanges changes;
+        const RenderItem* previous = nullptr;
+        for (size_t i = 0; i < items.size(); ++i) {
+            const RenderItem& item = items[order ? (*order)[i] : i];
+            if (!previous || item.pass != previous->pass) ++changes.passes;
+            if (!previous || item.program != previous->program) ++changes.programs;
+            if (!previous || item.texture != previous->texture) ++changes.textures;
+            if (!previous || item.material != previous->material) ++changes.materials;
+            if (!previous || !sameBatch(item, *previous)) ++changes.draw_calls;
+            previous = &item;
+        }
+        return changes;
+    }
+}
+
+uint64_t makeSortKey(const RenderItem& item, unsigned int mesh_id, float depth) {
+    const uint64_t DEPTH_MAX = (1u << 20) - 1;
+    uint64_t quantised_depth = static_cast<uint64_t>(std::clamp(depth, 0.0f, 1.0f) * DEPTH_MAX);
+    return (static_cast<uint64_t>(item.pass & 0xF) << 60) |
+           (static_cast<uint64_t>(item.program & 0xFF) << 52) |
+           (static_cast<uint64_t>(item.texture & 0xFF) << 44) |
+           (static_cast<uint64_t>(item.material & 0xFF) << 36) |
+           (static_cast<uint64_t>(mesh_id & 0xFFFF) << 20) |
+           quantised_depth;
+}
+
+void clearRenderQueue(RenderQueue& queue) {
+    queue.items.clear();
+    queue.keys.clear();
+    queue.order.clear();
+}
+
+void pushRenderItem(RenderQueue& queue, const RenderItem& item, unsigned int mesh_id, float depth) {
+    queue.order.push_back(static_cast<uint32_t>(queue.items.size()));
+    queue.keys.push_back(makeSortKey(item, mesh_id, depth));
+    queue.items.push_back(item);
+}
+
+void sortRenderQueue(RenderQueue& queue) {
+    queue.stats.items = static_cast<uint32_t>(queue.items.size());
+    queue.stats.unsorted = countStateChanges(queue.items, nullptr);
+    radixSort(queue.keys, queue.order, queue.scratch_keys, queue.scratch_order);
+}
+
+void submitDepthPrepass(RenderQueue& queue, ShaderProgram* depth_program, RingBuffer* ring, GpuProfiler* profiler) {
+    queue.batch.clear();
+    for (uint32_t index : queue.order) {
+        const RenderItem& item = queue.items[index];
+        if (item.pass == RENDER_PASS_OPAQUE) queue.batch.push_back(item.command);
+    }
+    if (queue.batch.empty()) return;
+
+    if (profiler) beginGpuPass(profiler, "depth prepass");
+    depth_program->use();
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    submitDraws(ring, queue.batch);
+    queue.batch.clear();
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    if (profiler) endGpuPass(profiler);
+}
+
+void submitRenderQueue(RenderQueue& queue, ShaderProgram* const programs[SHADER_VARIANT_COUNT],
+                       const MaterialLibrary* materials, RingBuffer* ring, GpuProfiler* profiler, bool depth_prepassed) {
+    RenderStateChanges& issued = queue.stats.sorted;
+    issued = RenderStateChanges();
+    queue.batch.clear();
+    glActiveTexture(GL_TEXTURE0);
+
+    const RenderItem* previous = nullptr;
+    for (uint32_t index : queue.order) {
+        const RenderItem& item = queue.items[index];
+        if (previous && sameBatch(item, *previous)) {
+            queue.batch.push_back(item.command);
+            continue;
+        }
+
+        if (!queue.batch.empty()) {
+            submitDraws(ring, queue.batch);
+            queue.batch.clear();
+        }
+
+        ShaderProgram* program = programs[item.program];
+        bool pass_changed = !previous || item.pass != previous->pass;
+        bool program_changed = !previous || item.program != previous->program;
+        if (program_changed) {
+            program->use();
+            ++issued.programs;
+        }
+        // render_wireframe lives on the program, so it follows both the pass and the program
+        if (pass_changed || program_changed) {
+            if (pass_changed) {
+                if (profiler) {
+                    if (previous) endGpuPass(profiler);
+                    beginGpuPass(profiler, RENDER_PASS_NAMES[item.pass]);
+                }
+                glPolygonMode(GL_FRONT_AND_BACK, item.pass == RENDER_PASS_WIREFRAME ? GL_LINE : GL_FILL);
+                // the pre-pass already wrote the opaque depth, equal keeps exactly the front surface
+                bool equal_depth = depth_prepassed && item.pass == RENDER_PASS_OPAQUE;
+                glDepthFunc(equal_depth ? GL_EQUAL : GL_LESS);
+                glDepthMask(equal_depth ? GL_FALSE : GL_TRUE);
+                ++issued.passes;
+            }
+            program->set(UNIFORM_RENDER_WIREFRAME, item.pass == RENDER_PASS_WIREFRAME);
+        }
+        if (!previous || item.texture != previous->texture) {
+            glBindTextureUnit(PRIMARY_TEXTURE_UNIT, item.texture);
+            ++issued.textures;
+        }
+        if (!previous || item.material != previous->material) {
+            bindMaterial(materials, item.material);
+            ++issued.materials;
+        }
+
+        ++issued.draw_calls;
+        queue.batch.push_back(item.command);
+        previous = &item;
+    }
+
+    if (!queue.batch.empty()) submitDraws(ring, queue.batch);
+    if (profiler && previous) endGpuPass(profiler);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+}
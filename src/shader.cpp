@@ -0,0 +1,426 @@
+#include "../include/glad/glad.h"
+#include "../include/shader.hpp"
+#include "../include/config.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+GLenum getShaderType(const std::string& file_extension) {
+    if (file_extension == ".vert") return GL_VERTEX_SHADER;
+    if (file_extension == ".frag") return GL_FRAGMENT_SHADER;
+    std::cerr << "invalid shader extension type: " << file_extension << "\n";
+    return 0;
+}
+
+std::string stringifyShaderSource(const std::string& file_path) {
+    std::ifstream shader_file(file_path);
+    if (!shader_file.is_open()) {
+        std::cerr << "failed to open shader file at: " + file_path << "\n";
+        return "";
+    }
+    std::stringstream buffer;
+    buffer << shader_file.rdbuf();
+    return buffer.str();
+};
+
+std::string injectDefines(const std::string& source, const std::vector<std::string>& defines) {
+    if (defines.empty()) return source;
+
+    size_t version = source.find("#version");
+    size_t insert_at = version == std::string::npos ? 0 : source.find('\n', version);
+    if (insert_at == std::string::npos) insert_at = source.size();
+    else if (version != std::string::npos) ++insert_at;
+
+    // count the lines before the insert so #line puts the rest back where it was
+    size_t next_line = 1 + std::count(source.begin(), source.begin() + insert_at, '\n');
+
+    std::string block;
+    for (const std::string& define : defines) {
+        block += "#define " + define + "\n";
+    }
+    block += "#line " + std::to_string(next_line) + "\n";
+    return source.substr(0, insert_at) + block + source.substr(insert_at);
+}
+
+namespace {
+    struct ShaderSource {
+        std::string path;
+        GLenum type;
+        std::string source; // defines already injected
+    };
+
+    ShaderCacheStats cache_stats;
+
+    // KHR_parallel_shader_compile isn't in the generated glad, so it's loaded by hand
+    constexpr GLenum GL_COMPLETION_STATUS_KHR = 0x91B1;
+    typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC max_compiler_threads = nullptr;
+    bool parallel_compile = false;
+
+    // the shaders are written against #version 460 but only use what 4.5 has, and some drivers
+    // (llvmpipe through EGL) stop at a 4.5 context. a newer #version than the context's is
+    // lowered to the context's so those still compile
+    std::string matchContextVersion(const std::string& source) {
+        size_t version = source.find("#version");
+        if (version == std::string::npos) return source;
+        size_t number = source.find_first_of("0123456789", version);
+        size_t number_end = source.find_first_not_of("0123456789", number);
+        if (number == std::string::npos || number_end == std::string::npos) return source;
+
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        const int context_version = major * 100 + minor * 10;
+        if (context_version < 330 || std::stoi(source.substr(number, number_end - number)) <= context_version) return source;
+        return source.substr(0, number) + std::to_string(context_version) + source.substr(number_end);
+    }
+
+    // every shader in the folder, sorted by path so the cache key doesn't depend on directory order
+    std::vector<ShaderSource> readShaderSources(const std::string& shader_folder_path, const std::vector<std::string>& defines) {
+        std::vector<ShaderSource> sources;
+        std::error_code error;
+        std::filesystem::directory_iterator folder(shader_folder_path, error);
+        if (error) {
+            std::cerr << "failed to open shader folder: " << shader_folder_path << " reason: " << error.message() << "\n";
+            return sources;
+        }
+        for (const auto& entry : folder) {
+            if (!entry.is_regular_file()) continue;
+
+            std::string file_path = entry.path().string();
+            GLenum shader_type = getShaderType(entry.path().extension().string());
+            if (shader_type == 0) continue;
+
+            std::string shader_source = stringifyShaderSource(file_path);
+            if (shader_source.empty()) {
+                std::cerr << "empty shader source for: " << file_path << "\n";
+                continue;
+            }
+            sources.push_back({file_path, shader_type, injectDefines(matchContextVersion(shader_source), defines)});
+        }
+        std::sort(sources.begin(), sources.end(), [](const ShaderSource& a, const ShaderSource& b) { return a.path < b.path; });
+        return sources;
+    }
+
+    uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    uint64_t hashString(uint64_t hash, const char* text) {
+        return text ? hashBytes(hash, text, std::strlen(text) + 1) : hash;
+    }
+
+    // binaries are only valid for the driver that produced them, so its identity is part of the key
+    uint64_t programCacheKey(const std::vector<ShaderSource>& sources) {
+        uint64_t key = 14695981039346656037ull;
+        key = hashString(key, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+        key = hashString(key, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+        key = hashString(key, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+        for (const ShaderSource& source : sources) {
+            key = hashBytes(key, &source.type, sizeof(source.type));
+            key = hashString(key, source.source.c_str());
+        }
+        return key;
+    }
+
+    std::string cacheFilePath(uint64_t key) {
+        std::ostringstream name;
+        name << CONFIG::SHADER_CACHE_PATH << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+        return name.str();
+    }
+
+    constexpr uint32_t PROGRAM_CACHE_MAGIC = 0x42475250; // "PRGB"
+
+    struct ProgramCacheHeader {
+        uint32_t magic;
+        uint32_t format;
+        uint64_t key;
+        uint64_t length;
+    };
+
+    bool linkSucceeded(unsigned int program) {
+        int success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        return success;
+    }
+
+    // 0 on a miss, including a binary the driver refuses (e.g. after a driver update)
+    unsigned int loadCachedProgram(uint64_t key) {
+        std::ifstream file(cacheFilePath(key), std::ios::binary);
+        if (!file) return 0;
+
+        ProgramCacheHeader header = {};
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            header.magic != PROGRAM_CACHE_MAGIC || header.key != key || header.length == 0) return 0;
+
+        // the length comes from disk, so a truncated or corrupt entry is a miss rather than
+        // an allocation of whatever it claims
+        const std::streamoff binary_start = file.tellg();
+        file.seekg(0, std::ios::end);
+        const std::streamoff remaining = file.tellg() - binary_start;
+        if (header.length > static_cast<uint64_t>(remaining) || header.length > static_cast<uint64_t>(INT32_MAX)) return 0;
+        file.seekg(binary_start);
+
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), static_cast<std::streamsize>(binary.size()))) return 0;
+
+        unsigned int program = glCreateProgram();
+        glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+        if (!linkSucceeded(program)) {
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    void saveProgramBinary(unsigned int program, uint64_t key) {
+        int length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+        std::error_code error;
+        std::filesystem::create_directories(CONFIG::SHADER_CACHE_PATH, error);
+        std::ofstream file(cacheFilePath(key), std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "failed to write shader cache entry: " << cacheFilePath(key) << "\n";
+            return;
+        }
+        ProgramCacheHeader header = {PROGRAM_CACHE_MAGIC, format, key, static_cast<uint64_t>(length)};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), length);
+    }
+
+    void printShaderLog(unsigned int shader, const std::string& path) {
+        int success = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (success) return;
+
+        char infoLog[512];
+        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+        std::cerr << "shader compilation failed: " << path << "\n" << infoLog << "\n";
+    }
+}
+
+void loadShaderCompilerExtensions(void* (*load)(const char* name)) {
+    parallel_compile = false;
+    int extension_count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+    for (int i = 0; i < extension_count; ++i) {
+        const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0) {
+            max_compiler_threads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(load("glMaxShaderCompilerThreadsKHR"));
+        } else if (std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0 && !max_compiler_threads) {
+            max_compiler_threads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(load("glMaxShaderCompilerThreadsARB"));
+        }
+    }
+    if (!max_compiler_threads) return;
+
+    // 0xFFFFFFFF lets the driver pick how many threads to use
+    max_compiler_threads(0xFFFFFFFFu);
+    parallel_compile = true;
+}
+
+bool hasParallelShaderCompile() {
+    return parallel_compile;
+}
+
+PendingShaderProgram* beginShaderProgram(const std::string& shader_folder_path, const std::vector<std::string>& defines) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<ShaderSource> sources = readShaderSources(shader_folder_path, defines);
+    if (sources.empty()) {
+        std::cerr << "no shaders were successfully compiled!" << std::endl;
+        return nullptr;
+    }
+
+    PendingShaderProgram* pending = new PendingShaderProgram();
+    pending->folder = shader_folder_path;
+
+    int binary_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binary_formats);
+    pending->retrievable = CONFIG::SHADER_CACHE && binary_formats > 0;
+    if (pending->retrievable) {
+        pending->cache_key = programCacheKey(sources);
+        pending->program = loadCachedProgram(pending->cache_key);
+    }
+
+    if (!pending->program) {
+        // nothing here asks for a status, that would make the driver finish the compile before
+        // returning. errors are collected in finishShaderProgram
+        pending->program = glCreateProgram();
+        if (pending->retrievable) glProgramParameteri(pending->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        for (const ShaderSource& source : sources) {
+            unsigned int shader = glCreateShader(source.type);
+            const char* shader_c_str = source.source.c_str();
+            glShaderSource(shader, 1, &shader_c_str, nullptr);
+            glCompileShader(shader);
+            glAttachShader(pending->program, shader);
+            pending->shaders.push_back(shader);
+            pending->paths.push_back(source.path);
+        }
+        glLinkProgram(pending->program);
+    }
+
+    pending->ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return pending;
+}
+
+bool isShaderProgramReady(const PendingShaderProgram* pending) {
+    if (!parallel_compile || pending->shaders.empty()) return true;
+    int complete = 0;
+    glGetProgramiv(pending->program, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete;
+}
+
+unsigned int finishShaderProgram(PendingShaderProgram* pending) {
+    auto start = std::chrono::steady_clock::now();
+    const bool from_cache = pending->shaders.empty();
+    unsigned int shader_program = pending->program;
+
+    // blocks here if the driver is still compiling
+    if (!from_cache && !linkSucceeded(shader_program)) {
+        for (size_t i = 0; i < pending->shaders.size(); ++i) {
+            printShaderLog(pending->shaders[i], pending->paths[i]);
+        }
+        char infoLog[512];
+        glGetProgramInfoLog(shader_program, 512, nullptr, infoLog);
+        std::cerr << "shader program linking failed: " << pending->folder << "\n" << infoLog << "\n";
+        glDeleteProgram(shader_program);
+        shader_program = 0;
+    }
+    for (unsigned int shader : pending->shaders) {
+        if (shader_program) glDetachShader(shader_program, shader);
+        glDeleteShader(shader);
+    }
+    if (shader_program && !from_cache && pending->retrievable) saveProgramBinary(shader_program, pending->cache_key);
+
+    float ms = pending->ms + std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    delete pending;
+    if (!shader_program) return 0;
+
+    if (from_cache) {
+        ++cache_stats.hits;
+        cache_stats.warm_ms += ms;
+        std::cout << "shader program loaded from cache in " << ms << "ms" << std::endl;
+    } else {
+        ++cache_stats.misses;
+        cache_stats.cold_ms += ms;
+        std::cout << "shader program linked successfully in " << ms << "ms" << std::endl;
+    }
+    return shader_program;
+}
+
+void cancelShaderProgram(PendingShaderProgram* pending) {
+    for (unsigned int shader : pending->shaders) glDeleteShader(shader);
+    glDeleteProgram(pending->program);
+    delete pending;
+}
+
+unsigned int createShaderProgram(const std::string& shader_folder_path, const std::vector<std::string>& defines) {
+    PendingShaderProgram* pending = beginShaderProgram(shader_folder_path, defines);
+    if (!pending) return 0;
+    return finishShaderProgram(pending);
+}
+
+const ShaderCacheStats& getShaderCacheStats() {
+    return cache_stats;
+}
+
+ShaderProgram* ShaderProgram::create(const std::string& shader_folder_path, const std::vector<std::string>& defines) {
+    unsigned int program = createShaderProgram(shader_folder_path, defines);
+    if (!program) return nullptr;
+    return new ShaderProgram(program);
+}
+
+ShaderProgram* ShaderProgram::create(PendingShaderProgram* pending) {
+    unsigned int program = finishShaderProgram(pending);
+    if (!program) return nullptr;
+    return new ShaderProgram(program);
+}
+
+ShaderProgram* ShaderProgram::create(const std::string& shader_folder_path, ShaderVariant variant) {
+    return create(shader_folder_path, SHADER_VARIANT_DEFINES[variant]);
+}
+
+ShaderProgram::ShaderProgram(unsigned int program) : program(program) {
+    reflectUniforms();
+}
+
+ShaderProgram::~ShaderProgram() {
+    glDeleteProgram(program);
+}
+
+void ShaderProgram::use() const {
+    glUseProgram(program);
+}
+
+// walks the linked program's active uniforms once and fills the flat location table
+void ShaderProgram::reflectUniforms() {
+    locations.fill(-1);
+
+    int uniform_count = 0;
+    int max_name_length = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniform_count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+    std::vector<char> name_buffer(max_name_length > 0 ? max_name_length : 1);
+    for (int i = 0; i < uniform_count; ++i) {
+        GLsizei name_length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, static_cast<GLuint>(i), static_cast<GLsizei>(name_buffer.size()), &name_length, &size, &type, name_buffer.data());
+
+        std::string name(name_buffer.data(), name_length);
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) name.resize(name.size() - 3);
+
+        bool known = false;
+        for (int u = 0; u < UNIFORM_COUNT; ++u) {
+            if (name == UNIFORM_NAMES[u]) {
+                locations[u] = glGetUniformLocation(program, name.c_str());
+                known = true;
+                break;
+            }
+        }
+        // uniforms inside blocks report no location and aren't set through here
+        if (!known && glGetUniformLocation(program, name.c_str()) != -1) {
+            std::cerr << "shader uniform has no handle in the Uniform enum: " << name << "\n";
+        }
+    }
+}
+
+void ShaderProgram::set(Uniform uniform, int value) const {
+    glProgramUniform1i(program, locations[uniform], value);
+}
+
+void ShaderProgram::set(Uniform uniform, bool value) const {
+    glProgramUniform1i(program, locations[uniform], static_cast<int>(value));
+}
+
+void ShaderProgram::set(Uniform uniform, float value) const {
+    glProgramUniform1f(program, locations[uniform], value);
+}
+
+void ShaderProgram::set(Uniform uniform, const glm::vec3& value) const {
+    glProgramUniform3fv(program, locations[uniform], 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::set(Uniform uniform, const glm::mat4& value) const {
+    glProgramUniformMatrix4fv(program, locations[uniform], 1, GL_FALSE, glm::value_ptr(value));
+}
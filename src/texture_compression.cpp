@@ -0,0 +1,306 @@
+#include "../include/glad/glad.h"
+#include "../include/texture_compression.hpp"
+#include "../include/config.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace {
+    constexpr uint32_t TEXTURE_CACHE_MAGIC = 0x58544342; // "BCTX"
+    constexpr uint32_t TEXTURE_CACHE_VERSION = 3; // bump when the encoder changes
+
+    struct TextureCacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t format;
+        int32_t width;
+        int32_t height;
+        int32_t levels;
+    };
+
+    int blockBytes(unsigned int format) {
+        return format == COMPRESSED_RGBA_BC3 ? 16 : 8;
+    }
+
+    // 2x2 box filter, edges clamp so odd sizes still cover every source texel
+    std::vector<unsigned char> downsample(const std::vector<unsigned char>& source, int width, int height, int channels) {
+        const int next_width = std::max(1, width / 2);
+        const int next_height = std::max(1, height / 2);
+        std::vector<unsigned char> next(static_cast<size_t>(next_width) * next_height * channels);
+        for (int y = 0; y < next_height; ++y) {
+            const int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+            for (int x = 0; x < next_width; ++x) {
+                const int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                for (int c = 0; c < channels; ++c) {
+                    int sum = source[(y0 * width + x0) * channels + c] + source[(y0 * width + x1) * channels + c] +
+                              source[(y1 * width + x0) * channels + c] + source[(y1 * width + x1) * channels + c];
+                    next[(y * next_width + x) * channels + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+        return next;
+    }
+
+    uint16_t packColor565(const float* rgb) {
+        auto quantize = [](float value, int max) { return static_cast<int>(std::clamp(value, 0.0f, 255.0f) * max / 255.0f + 0.5f); };
+        return static_cast<uint16_t>((quantize(rgb[0], 31) << 11) | (quantize(rgb[1], 63) << 5) | quantize(rgb[2], 31));
+    }
+
+    void unpackColor565(uint16_t color, float* rgb) {
+        int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+        rgb[0] = static_cast<float>((r << 3) | (r >> 2));
+        rgb[1] = static_cast<float>((g << 2) | (g >> 4));
+        rgb[2] = static_cast<float>((b << 3) | (b >> 2));
+    }
+
+    // endpoints are the two texels furthest apart along the block's principal axis (a few
+    // power iterations on the covariance), then every texel takes the nearest of the four
+    // palette entries
+    void encodeColorBlock(const float texels[16][4], unsigned char* out) {
+        float mean[3] = {};
+        for (int i = 0; i < 16; ++i) {
+            for (int c = 0; c < 3; ++c) mean[c] += texels[i][c] / 16.0f;
+        }
+        float covariance[6] = {}; // xx xy xz yy yz zz
+        for (int i = 0; i < 16; ++i) {
+            float d[3] = {texels[i][0] - mean[0], texels[i][1] - mean[1], texels[i][2] - mean[2]};
+            covariance[0] += d[0] * d[0]; covariance[1] += d[0] * d[1]; covariance[2] += d[0] * d[2];
+            covariance[3] += d[1] * d[1]; covariance[4] += d[1] * d[2]; covariance[5] += d[2] * d[2];
+        }
+        float axis[3] = {1.0f, 1.0f, 1.0f};
+        for (int iteration = 0; iteration < 4; ++iteration) {
+            float next[3] = {
+                covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+                covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+                covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2],
+            };
+            float length = std::max({std::fabs(next[0]), std::fabs(next[1]), std::fabs(next[2])});
+            if (length < 1e-6f) break;
+            for (int c = 0; c < 3; ++c) axis[c] = next[c] / length;
+        }
+
+        int lowest = 0, highest = 0;
+        float lowest_t = INFINITY, highest_t = -INFINITY;
+        for (int i = 0; i < 16; ++i) {
+            float t = texels[i][0] * axis[0] + texels[i][1] * axis[1] + texels[i][2] * axis[2];
+            if (t < lowest_t) { lowest_t = t; lowest = i; }
+            if (t > highest_t) { highest_t = t; highest = i; }
+        }
+
+        uint16_t color0 = packColor565(texels[highest]);
+        uint16_t color1 = packColor565(texels[lowest]);
+        // color0 > color1 selects the four colour mode, equal endpoints leave every index 0
+        if (color0 < color1) std::swap(color0, color1);
+
+        float palette[4][3];
+        unpackColor565(color0, palette[0]);
+        unpackColor565(color1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            for (int i = 0; i < 16; ++i) {
+                int best = 0;
+                float best_distance = INFINITY;
+                for (int p = 0; p < 4; ++p) {
+                    float dr = texels[i][0] - palette[p][0], dg = texels[i][1] - palette[p][1], db = texels[i][2] - palette[p][2];
+                    float distance = dr * dr + dg * dg + db * db;
+                    if (distance < best_distance) { best_distance = distance; best = p; }
+                }
+                indices |= static_cast<uint32_t>(best) << (2 * i);
+            }
+        }
+
+        out[0] = color0 & 0xFF; out[1] = color0 >> 8;
+        out[2] = color1 & 0xFF; out[3] = color1 >> 8;
+        for (int b = 0; b < 4; ++b) out[4 + b] = (indices >> (8 * b)) & 0xFF;
+    }
+
+    // the bc3 alpha block and bc4 share this layout, min and max as endpoints in the eight
+    // value mode
+    void encodeChannelBlock(const float texels[16][4], int channel, unsigned char* out) {
+        float low = 255.0f, high = 0.0f;
+        for (int i = 0; i < 16; ++i) {
+            low = std::min(low, texels[i][channel]);
+            high = std::max(high, texels[i][channel]);
+        }
+        const int endpoint0 = static_cast<int>(high + 0.5f), endpoint1 = static_cast<int>(low + 0.5f);
+
+        float palette[8] = {static_cast<float>(endpoint0), static_cast<float>(endpoint1)};
+        for (int p = 1; p < 7; ++p) {
+            palette[p + 1] = ((7 - p) * palette[0] + p * palette[1]) / 7.0f;
+        }
+
+        uint64_t indices = 0;
+        if (endpoint0 != endpoint1) {
+            for (int i = 0; i < 16; ++i) {
+                int best = 0;
+                float best_distance = INFINITY;
+                for (int p = 0; p < 8; ++p) {
+                    float distance = std::fabs(texels[i][channel] - palette[p]);
+                    if (distance < best_distance) { best_distance = distance; best = p; }
+                }
+                indices |= static_cast<uint64_t>(best) << (3 * i);
+            }
+        }
+
+        out[0] = static_cast<unsigned char>(endpoint0);
+        out[1] = static_cast<unsigned char>(endpoint1);
+        for (int b = 0; b < 6; ++b) out[2 + b] = (indices >> (8 * b)) & 0xFF;
+    }
+
+    void encodeLevel(const unsigned char* pixels, int width, int height, int channels, unsigned int format, unsigned char* out) {
+        const int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+        float texels[16][4];
+        for (int by = 0; by < blocks_y; ++by) {
+            for (int bx = 0; bx < blocks_x; ++bx) {
+                // blocks hanging off the edge repeat the last row and column
+                for (int i = 0; i < 16; ++i) {
+                    const int x = std::min(bx * 4 + i % 4, width - 1), y = std::min(by * 4 + i / 4, height - 1);
+                    const unsigned char* texel = pixels + (static_cast<size_t>(y) * width + x) * channels;
+                    for (int c = 0; c < 4; ++c) texels[i][c] = c < channels ? texel[c] : 255.0f;
+                }
+
+                if (format == COMPRESSED_RED_BC4) {
+                    encodeChannelBlock(texels, 0, out);
+                } else if (format == COMPRESSED_RGBA_BC3) {
+                    encodeChannelBlock(texels, 3, out);
+                    encodeColorBlock(texels, out + 8);
+                } else {
+                    encodeColorBlock(texels, out);
+                }
+                out += blockBytes(format);
+            }
+        }
+    }
+
+    // where each level starts for a full mip chain of width x height blocks in format, plus the total
+    std::vector<uint32_t> levelOffsets(unsigned int format, int width, int height) {
+        const int levels = 1 + static_cast<int>(std::floor(std::log2(std::max(width, height))));
+        std::vector<uint32_t> offsets(1, 0);
+        for (int level = 0; level < levels; ++level) {
+            const int level_width = std::max(1, width >> level), level_height = std::max(1, height >> level);
+            const uint32_t size = static_cast<uint32_t>(((level_width + 3) / 4) * ((level_height + 3) / 4) * blockBytes(format));
+            offsets.push_back(offsets.back() + size);
+        }
+        return offsets;
+    }
+
+    std::string cacheFilePath(uint64_t key) {
+        std::ostringstream name;
+        name << CONFIG::TEXTURE_CACHE_PATH << std::hex << std::setw(16) << std::setfill('0') << key << ".btex";
+        return name.str();
+    }
+}
+
+bool hasTextureCompression() {
+    static int supported = -1;
+    if (supported < 0) {
+        supported = 0;
+        int extension_count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+        for (int i = 0; i < extension_count; ++i) {
+            if (std::strcmp(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i)), "GL_EXT_texture_compression_s3tc") == 0) supported = 1;
+        }
+    }
+    return supported == 1;
+}
+
+bool compressImage(const unsigned char* pixels, int width, int height, int channels, CompressedImage& out) {
+    if (channels == 1) out.format = COMPRESSED_RED_BC4;
+    else if (channels == 3) out.format = COMPRESSED_RGB_BC1;
+    else if (channels == 4) out.format = COMPRESSED_RGBA_BC3;
+    else return false;
+
+    out.width = width;
+    out.height = height;
+    out.level_offsets = levelOffsets(out.format, width, height);
+    const int levels = compressedLevels(out);
+    out.blocks.resize(out.level_offsets.back());
+
+    std::vector<unsigned char> level_pixels(pixels, pixels + static_cast<size_t>(width) * height * channels);
+    for (int level = 0; level < levels; ++level) {
+        const int level_width = std::max(1, width >> level), level_height = std::max(1, height >> level);
+        encodeLevel(level_pixels.data(), level_width, level_height, channels, out.format, out.blocks.data() + out.level_offsets[level]);
+        if (level + 1 < levels) level_pixels = downsample(level_pixels, level_width, level_height, channels);
+    }
+    return true;
+}
+
+uint64_t textureCacheKey(const std::filesystem::path& texture_path, bool upside_down) {
+    std::error_code error;
+    const std::string path = std::filesystem::absolute(texture_path, error).string();
+    const uint64_t size = std::filesystem::file_size(texture_path, error);
+    const int64_t modified = static_cast<int64_t>(std::filesystem::last_write_time(texture_path, error).time_since_epoch().count());
+
+    uint64_t key = 14695981039346656037ull;
+    auto mix = [&](const void* data, size_t length) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < length; ++i) key = (key ^ bytes[i]) * 1099511628211ull;
+    };
+    mix(path.data(), path.size());
+    mix(&size, sizeof(size));
+    mix(&modified, sizeof(modified));
+    mix(&upside_down, sizeof(upside_down));
+    mix(&TEXTURE_CACHE_VERSION, sizeof(TEXTURE_CACHE_VERSION));
+    return key;
+}
+
+bool readTextureCache(uint64_t key, CompressedImage& out) {
+    std::ifstream file(cacheFilePath(key), std::ios::binary);
+    if (!file) return false;
+
+    TextureCacheHeader header = {};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != TEXTURE_CACHE_MAGIC ||
+        header.version != TEXTURE_CACHE_VERSION || header.key != key || header.levels <= 0 || header.levels > 32) return false;
+
+    // the offsets are read from disk and later index the blocks, so they have to be exactly
+    // what this format and size produce or the entry counts as a miss
+    const bool known_format = header.format == COMPRESSED_RGB_BC1 || header.format == COMPRESSED_RGBA_BC3 ||
+                              header.format == COMPRESSED_RED_BC4;
+    if (!known_format || header.width <= 0 || header.height <= 0 || header.width > 32768 || header.height > 32768) return false;
+    const std::vector<uint32_t> expected = levelOffsets(header.format, header.width, header.height);
+    if (static_cast<size_t>(header.levels) + 1 != expected.size()) return false;
+
+    out.format = header.format;
+    out.width = header.width;
+    out.height = header.height;
+    out.level_offsets.resize(header.levels + 1);
+    if (!file.read(reinterpret_cast<char*>(out.level_offsets.data()), out.level_offsets.size() * sizeof(uint32_t))) return false;
+    if (out.level_offsets != expected) return false;
+    out.blocks.resize(out.level_offsets.back());
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(out.blocks.data()), out.blocks.size()));
+}
+
+void writeTextureCache(uint64_t key, const CompressedImage& image) {
+    std::error_code error;
+    std::filesystem::create_directories(CONFIG::TEXTURE_CACHE_PATH, error);
+
+    // written under a temporary name and renamed, so a reader never sees half a file
+    const std::string path = cacheFilePath(key);
+    const std::string temporary = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "failed to write texture cache entry: " << path << "\n";
+            return;
+        }
+        TextureCacheHeader header = {TEXTURE_CACHE_MAGIC, TEXTURE_CACHE_VERSION, key, image.format, image.width, image.height, compressedLevels(image)};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(image.level_offsets.data()), image.level_offsets.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(image.blocks.data()), image.blocks.size());
+    }
+    std::filesystem::rename(temporary, path, error);
+    if (error) std::filesystem::remove(temporary, error);
+}
@@ -0,0 +1,328 @@
+#include "../include/glad/glad.h"
+#include "../include/textures.hpp"
+#include "../include/config.hpp"
+#include "../include/render.hpp"
+#include "../include/texture_compression.hpp"
+
+#include "../include/stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    unsigned int internalFormatFor(int channels) {
+        if (channels == 1) return GL_R8;
+        if (channels == 3) return GL_RGB8;
+        if (channels == 4) return GL_RGBA8;
+        return 0;
+    }
+
+    GLenum pixelFormatFor(int channels) {
+        if (channels == 1) return GL_RED;
+        if (channels == 3) return GL_RGB;
+        return GL_RGBA;
+    }
+
+    unsigned int createArrayStorage(const TextureArray& array) {
+        unsigned int texture;
+        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+        glTextureStorage3D(texture, array.levels, array.internal_format, array.width, array.height, array.capacity);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return texture;
+    }
+
+    // storage is immutable, so growing is a new array twice the size with every level copied
+    // across on the gpu
+    bool growArray(TextureArray& array) {
+        int max_layers = 0;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+        if (array.capacity >= static_cast<unsigned int>(max_layers)) return false;
+
+        TextureArray grown = array;
+        grown.capacity = std::min(array.capacity * 2, static_cast<unsigned int>(max_layers));
+        grown.texture = createArrayStorage(grown);
+        for (int level = 0; level < array.levels; ++level) {
+            glCopyImageSubData(array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                               grown.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                               std::max(1, array.width >> level), std::max(1, array.height >> level), array.layers);
+        }
+        glDeleteTextures(1, &array.texture);
+        array = grown;
+        return true;
+    }
+
+    // an array with room for one more layer of this size and format, made if none fits
+    int findArray(TextureManager* manager, int width, int height, unsigned int internal_format) {
+        for (size_t i = 0; i < manager->arrays.size(); ++i) {
+            TextureArray& array = manager->arrays[i];
+            if (array.width != width || array.height != height || array.internal_format != internal_format) continue;
+            if (array.layers < array.capacity || growArray(array)) return static_cast<int>(i);
+        }
+        if (manager->arrays.size() > UINT16_MAX) return -1;
+
+        TextureArray array;
+        array.width = width;
+        array.height = height;
+        array.levels = 1 + static_cast<int>(std::floor(std::log2(std::max(width, height))));
+        array.internal_format = internal_format;
+        array.capacity = static_cast<unsigned int>(CONFIG::TEXTURE_ARRAY_INITIAL_LAYERS);
+        array.texture = createArrayStorage(array);
+        manager->arrays.push_back(array);
+        return static_cast<int>(manager->arrays.size() - 1);
+    }
+
+    // internal_format is either internalFormatFor(channels) or a block compressed format
+    bool reserveLayer(TextureManager* manager, int width, int height, unsigned int internal_format, TextureSlot& slot) {
+        if (!internal_format || width <= 0 || height <= 0) {
+            std::cerr << "unsupported texture layout: " << width << "x" << height << " (format 0x" << std::hex << internal_format << std::dec << ")\n";
+            return false;
+        }
+
+        int array_index = findArray(manager, width, height, internal_format);
+        if (array_index < 0) {
+            std::cerr << "no texture array has room for a " << width << "x" << height << " texture\n";
+            return false;
+        }
+        slot.array = static_cast<uint16_t>(array_index);
+        slot.layer = static_cast<uint16_t>(manager->arrays[array_index].layers++);
+        return true;
+    }
+
+    // pixels is an offset into GL_PIXEL_UNPACK_BUFFER when one is bound
+    void writeLayer(const TextureArray& array, unsigned int layer, const void* pixels, int channels) {
+        // rows are tightly packed, which breaks the default 4 byte alignment for rgb and red
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTextureSubImage3D(array.texture, 0, 0, 0, layer, array.width, array.height, 1, pixelFormatFor(channels), GL_UNSIGNED_BYTE, pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        // a view of just this layer, so only its mips are rebuilt rather than the whole array's
+        if (array.levels > 1) {
+            unsigned int view;
+            glGenTextures(1, &view);
+            glTextureView(view, GL_TEXTURE_2D_ARRAY, array.texture, array.internal_format, 0, array.levels, layer, 1);
+            glGenerateTextureMipmap(view);
+            glDeleteTextures(1, &view);
+        }
+    }
+
+    // blocks is an offset into GL_PIXEL_UNPACK_BUFFER when one is bound. every level comes
+    // from the image, nothing is generated
+    void writeCompressedLayer(const TextureArray& array, unsigned int layer, const unsigned char* blocks, const CompressedImage& image) {
+        const int levels = std::min(array.levels, compressedLevels(image));
+        for (int level = 0; level < levels; ++level) {
+            glCompressedTextureSubImage3D(array.texture, level, 0, 0, layer,
+                                          std::max(1, array.width >> level), std::max(1, array.height >> level), 1, image.format,
+                                          image.level_offsets[level + 1] - image.level_offsets[level], blocks + image.level_offsets[level]);
+        }
+    }
+
+    // stb's flip flag is global unless set per thread, and decodes run on several threads
+    unsigned char* decodeImage(const std::filesystem::path& texture_path, bool upside_down, int& width, int& height, int& channels) {
+        stbi_set_flip_vertically_on_load_thread(upside_down);
+        unsigned char *data = stbi_load(texture_path.string().c_str(), &width, &height, &channels, 0);
+        if (!data) {
+            std::cerr << "failed to load texture at: " << texture_path << " reason: " << stbi_failure_reason() << "\n";
+            return nullptr;
+        }
+
+        // 2 channel (grey + alpha) images have no matching format here, so they're expanded
+        if (channels == 2) {
+            stbi_image_free(data);
+            data = stbi_load(texture_path.string().c_str(), &width, &height, &channels, 4);
+            channels = 4;
+        }
+        return data;
+    }
+
+    // the cached blocks when they're current, otherwise decodes, transcodes and caches them
+    bool loadCompressedImage(const std::filesystem::path& texture_path, bool upside_down, CompressedImage& out) {
+        const uint64_t key = textureCacheKey(texture_path, upside_down);
+        if (readTextureCache(key, out)) return true;
+
+        int width, height, channels;
+        unsigned char* data = decodeImage(texture_path, upside_down, width, height, channels);
+        if (!data) return false;
+        const bool compressed = compressImage(data, width, height, channels, out);
+        stbi_image_free(data);
+        if (compressed) writeTextureCache(key, out);
+        return compressed;
+    }
+
+    unsigned int uploadBytes(const DecodedTexture& image) {
+        if (image.compressed.format) return static_cast<unsigned int>(image.compressed.blocks.size());
+        return static_cast<unsigned int>(image.width * image.height * image.channels);
+    }
+
+    void decodeWorker(TextureLoader* loader) {
+        while (true) {
+            TextureRequest request;
+            {
+                std::unique_lock<std::mutex> lock(loader->mutex);
+                loader->wake.wait(lock, [&] { return loader->stopping || !loader->requests.empty(); });
+                if (loader->stopping) return;
+                request = std::move(loader->requests.front());
+                loader->requests.pop_front();
+            }
+
+            DecodedTexture image;
+            image.id = request.id;
+            if (request.compress) {
+                loadCompressedImage(request.path, request.upside_down, image.compressed);
+            } else {
+                image.pixels = decodeImage(request.path, request.upside_down, image.width, image.height, image.channels);
+            }
+
+            std::lock_guard<std::mutex> lock(loader->mutex);
+            loader->decoded.push_back(std::move(image));
+        }
+    }
+}
+
+TextureManager* createTextureManager() {
+    TextureManager* manager = new TextureManager();
+    manager->compress = CONFIG::TEXTURE_COMPRESSION && hasTextureCompression();
+    const unsigned char WHITE[4] = {255, 255, 255, 255};
+    addTexture(manager, WHITE, 1, 1, 4);
+    return manager;
+}
+
+void destroyTextureManager(TextureManager* manager) {
+    for (TextureArray& array : manager->arrays) {
+        glDeleteTextures(1, &array.texture);
+    }
+    delete manager;
+}
+
+unsigned int addTexture(TextureManager* manager, const unsigned char* pixels, int width, int height, int channels) {
+    TextureSlot slot;
+    if (!reserveLayer(manager, width, height, internalFormatFor(channels), slot)) return FALLBACK_TEXTURE;
+    writeLayer(manager->arrays[slot.array], slot.layer, pixels, channels);
+
+    manager->slots.push_back(slot);
+    return static_cast<unsigned int>(manager->slots.size() - 1);
+}
+
+unsigned int addCompressedTexture(TextureManager* manager, const CompressedImage& image) {
+    TextureSlot slot;
+    if (!reserveLayer(manager, image.width, image.height, image.format, slot)) return FALLBACK_TEXTURE;
+    writeCompressedLayer(manager->arrays[slot.array], slot.layer, image.blocks.data(), image);
+
+    manager->slots.push_back(slot);
+    return static_cast<unsigned int>(manager->slots.size() - 1);
+}
+
+unsigned int loadTexture(TextureManager* manager, const std::filesystem::path& texture_path, bool upside_down) {
+    if (manager->compress) {
+        CompressedImage image;
+        if (!loadCompressedImage(texture_path, upside_down, image)) return FALLBACK_TEXTURE;
+        return addCompressedTexture(manager, image);
+    }
+
+    int width, height, channels;
+    unsigned char* data = decodeImage(texture_path, upside_down, width, height, channels);
+    if (!data) return FALLBACK_TEXTURE;
+
+    unsigned int id = addTexture(manager, data, width, height, channels);
+    stbi_image_free(data);
+    return id;
+}
+
+TextureLoader* createTextureLoader(unsigned int thread_count) {
+    TextureLoader* loader = new TextureLoader();
+    loader->staging = createRingBuffer(CONFIG::TEXTURE_UPLOAD_BUDGET);
+    if (thread_count == 0) thread_count = std::max(1u, std::thread::hardware_concurrency() / 2);
+    for (unsigned int t = 0; t < thread_count; ++t) {
+        loader->workers.emplace_back(decodeWorker, loader);
+    }
+    return loader;
+}
+
+void destroyTextureLoader(TextureLoader* loader) {
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        loader->stopping = true;
+    }
+    loader->wake.notify_all();
+    for (std::thread& worker : loader->workers) worker.join();
+
+    for (DecodedTexture& image : loader->decoded) stbi_image_free(image.pixels);
+    destroyRingBuffer(loader->staging);
+    delete loader;
+}
+
+unsigned int requestTexture(TextureManager* manager, TextureLoader* loader, const std::filesystem::path& texture_path, bool upside_down) {
+    manager->slots.push_back(manager->slots[FALLBACK_TEXTURE]);
+    unsigned int id = static_cast<unsigned int>(manager->slots.size() - 1);
+    ++loader->in_flight;
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        loader->requests.push_back({id, texture_path, upside_down, manager->compress});
+    }
+    loader->wake.notify_one();
+    return id;
+}
+
+unsigned int updateTextureLoader(TextureLoader* loader, TextureManager* manager) {
+    if (loader->in_flight == 0) return 0;
+
+    RingBuffer* staging = loader->staging;
+    beginRingFrame(staging);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging->buffer);
+
+    unsigned int uploaded = 0;
+    while (true) {
+        DecodedTexture image;
+        {
+            std::lock_guard<std::mutex> lock(loader->mutex);
+            if (loader->decoded.empty()) break;
+
+            const DecodedTexture& next = loader->decoded.front();
+            const bool loaded = next.pixels || next.compressed.format;
+            const unsigned int bytes = uploadBytes(next);
+            const unsigned int start = (staging->head + 3) & ~3u;
+            // one bigger than the whole budget goes straight from client memory, on a frame of its own
+            if (loaded && start + bytes > staging->frame_size && !(bytes > staging->frame_size && uploaded == 0)) break;
+
+            image = std::move(loader->decoded.front());
+            loader->decoded.pop_front();
+        }
+        --loader->in_flight;
+
+        const bool compressed = image.compressed.format != 0;
+        if (!image.pixels && !compressed) continue;
+
+        const unsigned int bytes = uploadBytes(image);
+        const bool oversized = bytes > staging->frame_size;
+        const unsigned char* source = compressed ? image.compressed.blocks.data() : image.pixels;
+        TextureSlot slot;
+        const bool reserved = compressed ? reserveLayer(manager, image.compressed.width, image.compressed.height, image.compressed.format, slot)
+                                         : reserveLayer(manager, image.width, image.height, internalFormatFor(image.channels), slot);
+        if (reserved) {
+            if (!oversized) {
+                RingAllocation allocation = ringAllocate(staging, bytes, 4);
+                std::memcpy(allocation.data, source, bytes);
+                source = reinterpret_cast<const unsigned char*>(static_cast<uintptr_t>(allocation.offset));
+            } else {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+
+            if (compressed) writeCompressedLayer(manager->arrays[slot.array], slot.layer, source, image.compressed);
+            else writeLayer(manager->arrays[slot.array], slot.layer, source, image.channels);
+
+            if (oversized) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging->buffer);
+            manager->slots[image.id] = slot;
+            ++uploaded;
+        }
+        stbi_image_free(image.pixels);
+        if (oversized) break;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    endRingFrame(staging);
+    return uploaded;
+}
@@ -8,3 +8,31 @@
 glm::vec3 midpoint(glm::vec3 a, glm::vec3 b) {
   return 0.5f * (a + b);
 }
+
+// gribb/hartmann: every plane is the last row of the matrix plus or minus one of the others
+Frustum extractFrustum(const glm::mat4& view_projection) {
+  glm::vec4 row[4];
+  for (int i = 0; i < 4; ++i) {
+    row[i] = glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+  }
+
+  Frustum frustum;
+  frustum.planes[0] = row[3] + row[0];
+  frustum.planes[1] = row[3] - row[0];
+  frustum.planes[2] = row[3] + row[1];
+  frustum.planes[3] = row[3] - row[1];
+  frustum.planes[4] = row[3] + row[2];
+  frustum.planes[5] = row[3] - row[2];
+
+  for (auto& plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane.x, plane.y, plane.z));
+  }
+  return frustum;
+}
+
+bool sphereInFrustum(const Frustum& frustum, const glm::vec3& center, float radius) {
+  for (const auto& plane : frustum.planes) {
+    if (glm::dot(glm::vec3(plane.x, plane.y, plane.z), center) + plane.w < -radius) return false;
+  }
+  return true;
+}